@@ -6,322 +6,490 @@
  */
 
 #include "Interrupts_101166589_101257741.hpp"
-#include <climits>
-
-
-
-std::tuple<std::string, std::string, int> simulate_trace(std::vector<std::string> trace_file, int time, std::vector<std::string> vectors, std::vector<int> delays, std::vector<external_file> external_files, PCB current, std::vector<PCB> wait_queue) {
-
-    std::string trace;      //!< string to store single line of trace file
-    std::string execution = "";  //!< string to accumulate the execution output
-    std::string system_status = "";  //!< string to accumulate the system status output
-    int current_time = time;
-
-    //parse each line of the input trace file. 'for' loop to keep track of indices.
-    for(size_t i = 0; i < trace_file.size(); i++) {
-        auto trace = trace_file[i];
-
-        auto [activity, duration_intr, program_name] = parse_trace(trace);
-
-        if(activity == "CPU") { //As per Assignment 1
-            execution += std::to_string(current_time) + ", " + std::to_string(duration_intr) + ", CPU Burst\n";
-            current_time += duration_intr;
-        } else if(activity == "SYSCALL") { //As per Assignment 1
-            auto [intr, time] = intr_boilerplate(current_time, duration_intr, 10, vectors);
-            execution += intr;
-            current_time = time;
-
-            execution += std::to_string(current_time) + ", " + std::to_string(delays[duration_intr]) + ", SYSCALL ISR (ADD STEPS HERE)\n";
-            current_time += delays[duration_intr];
-
-            execution +=  std::to_string(current_time) + ", 1, IRET\n";
-            current_time += 1;
-        } else if(activity == "END_IO") {
-            auto [intr, time] = intr_boilerplate(current_time, duration_intr, 10, vectors);
-            current_time = time;
-            execution += intr;
-
-            execution += std::to_string(current_time) + ", " + std::to_string(delays[duration_intr]) + ", ENDIO ISR(ADD STEPS HERE)\n";
-            current_time += delays[duration_intr];
-
-            execution +=  std::to_string(current_time) + ", 1, IRET\n";
-            current_time += 1;
-        } else if(activity == "FORK") {
-            auto [intr, time] = intr_boilerplate(current_time, 2, 10, vectors);
-            execution += intr;
-            current_time = time;
-
-            ///////////////////////////////////////////////////////////////////////////////////////////
-            //FORK implementation
-            
-            // Calculate next PID inline
-            unsigned int child_pid = 1;
-            for (const auto& pcb : wait_queue) {
-                if (pcb.PID >= child_pid) child_pid = pcb.PID + 1;
-            }
-            if (current.PID >= child_pid) child_pid = current.PID + 1;
-            
-            // Find available partition using BEST FIT algorithm
-            int child_partition = -1;
-            int best_fit_size = INT_MAX;
-            for(int j = 0; j < 6; j++) {
-                if(memory[j].code == "empty" && memory[j].size >= current.size) {
-                    int wasted_space = memory[j].size - current.size;
-                    if(wasted_space < best_fit_size) {
-                        best_fit_size = wasted_space;
-                        child_partition = memory[j].partition_number;
-                    }
-                }
-            }
 
-            // Declare child PCB outside if block so it's accessible later
-            PCB child(child_pid, current.PID, current.program_name, current.size, child_partition);
-
-            if(child_partition == -1) {
-                execution += std::to_string(current_time) + ", FORK ERROR: No available partition\n";
-            } else {
-                execution += std::to_string(current_time) + ", " + std::to_string(duration_intr) + ", cloning the PCB\n";
-                memory[child_partition - 1].code = current.program_name;
-                current_time += duration_intr;
-
-                execution += std::to_string(current_time) + ", 0, scheduler called\n";
-                execution += std::to_string(current_time) + ", 1, IRET\n";
-                current_time += 1;
-
-                ///////////////////////////////////////////////////////////////////////////////////////////
-                //SYSTEM STATUS for FORK (ADD STEPS HERE)
-                
-                // Build waiting processes list: parent first, then wait_queue
-                std::vector<PCB> fork_waiting_pcbs;
-                fork_waiting_pcbs.push_back(current);
-                for (const auto& pcb : wait_queue) {
-                    fork_waiting_pcbs.push_back(pcb);
-                }
-                
-                // Use helper function to append system status (child is running)
-                append_system_status(system_status, current_time, "FORK", duration_intr, 
-                                   child, fork_waiting_pcbs);
-                
-                ///////////////////////////////////////////////////////////////////////////////////////////
-            }           
-            ///////////////////////////////////////////////////////////////////////////////////////////
-
-            //The following loop helps you do 2 things:
-            // * Collect the trace of the child (and only the child, skip parent)
-            // * Get the index of where the parent is supposed to start executing from
-            std::vector<std::string> child_trace;
-            bool skip = true;
-            bool exec_flag = false;
-            int parent_index = 0;
-
-            for(size_t j = i; j < trace_file.size(); j++) {
-                auto [_activity, _duration, _pn] = parse_trace(trace_file[j]);
-                if(skip && _activity == "IF_CHILD") {
-                    skip = false;
-                    continue;
-                } else if(_activity == "IF_PARENT"){
-                    skip = true;
-                    parent_index = j;
-                    if(exec_flag) {
-                        break;
-                    }
-                } else if(skip && _activity == "ENDIF") {
-                    skip = false;
-                    continue;
-                } else if(!skip && _activity == "EXEC") {
-                    skip = true;
-                    child_trace.push_back(trace_file[j]);
-                    exec_flag = true;
-                }
 
-                if(!skip) {
-                    child_trace.push_back(trace_file[j]);
-                }
-            }
-            i = parent_index;
-
-            ///////////////////////////////////////////////////////////////////////////////////////////
-            //With the child's trace, run the child (HINT: think recursion)
-
-            if(child_partition != -1 && child_trace.size() > 0) {
-                // Create child_wait_queue with parent added
-                std::vector<PCB> child_wait_queue = wait_queue;
-                child_wait_queue.push_back(current);
-                
-                auto [child_execution, child_status, new_time] = simulate_trace(
-                    child_trace, current_time, vectors, delays, external_files, 
-                    child, child_wait_queue);
-                execution += child_execution;
-                system_status += child_status;
-                current_time = new_time;
-
-                memory[child_partition - 1].code = "empty";
-            }
 
-            ///////////////////////////////////////////////////////////////////////////////////////////
+/**
+ * \brief run one simulation from start to finish
+ *
+ * Streams both logs to the given files while the simulation runs.
+ * 
+ * @param trace the compiled trace to run
+ * @param context the tables of the simulation
+ * @param options how the simulation runs
+ * @param execution_file where the execution log goes
+ * @param status_file where the system status log goes
+ * @param delta_interval -1 for full system status tables, otherwise write deltas with
+ *                       a full table every delta_interval tables (0: only the first)
+ * @return false if the output files could not be opened
+ * 
+ */
+bool run_simulation(const compiled_trace& trace, const simulation_context& context,
+                    const simulation_options& options, const std::string& execution_file, const std::string& status_file,
+                    int delta_interval = -1) {
+
+    text_log_sink sink(execution_file.c_str(), status_file.c_str(), context.vectors);
+    if(!sink.is_open()) {
+        std::cerr << "Error opening file!" << std::endl;
+        return false;
+    }
+    if(delta_interval >= 0) {
+        sink.use_status_deltas(delta_interval);
+    }
 
-        } else if(activity == "EXEC") {
-            std::cerr << "DEBUG: EXEC activity - program_name = '" << program_name << "'" << std::endl;
+    std::string error;
+    if(!simulate(trace, context, options, sink, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    sink.flush();
 
-            auto [intr, time] = intr_boilerplate(current_time, 3, 10, vectors);
-            current_time = time;
-            execution += intr;
+    //one write, so lines of simulations running in parallel do not interleave
+    std::cout << "Output generated in " + execution_file + " and " + status_file + "\n" << std::flush;
+    return true;
+}
 
-            ///////////////////////////////////////////////////////////////////////////////////////////
-            //EXEC implementation
+/**
+ * \brief run_simulation with checkpoints, or going on from one
+ *
+ * A resumed run cuts both logs back to what was written when the checkpoint was taken
+ * and appends to them, so once it finishes they are byte for byte the logs of a run
+ * that never stopped. To fork what-if runs from one prefix, give each a copy of the
+ * logs and the checkpoint.
+ *
+ * @param trace the compiled trace to run
+ * @param context the tables of the simulation
+ * @param options how the simulation runs; only the run to completion engine checkpoints
+ * @param checkpoints when to take checkpoints and what to resume from
+ * @param execution_file where the execution log goes
+ * @param status_file where the system status log goes
+ * @param checkpoint_prefix where the checkpoints go (see checkpointer)
+ * @return false if the output files could not be opened or be cut back
+ *
+ */
+bool run_checkpointed_simulation(const compiled_trace& trace, const simulation_context& context,
+                                 const simulation_options& options, const checkpoint_options& checkpoints,
+                                 const std::string& execution_file, const std::string& status_file,
+                                 const std::string& checkpoint_prefix) {
+
+    std::unique_ptr<simulation_checkpoint> resume;
+    std::ios::openmode mode = std::ios::out;
+    if(!checkpoints.resume.empty()) {
+        resume = std::make_unique<simulation_checkpoint>(load_checkpoint(checkpoints.resume));
+        if(!truncate_log(execution_file, resume->execution_offset) || !truncate_log(status_file, resume->status_offset)) {
+            std::cerr << "Error: " << execution_file << " and " << status_file
+                      << " are not the logs the checkpoint was taken with" << std::endl;
+            return false;
+        }
+        mode = std::ios::app;
+    }
 
-            // Get program size inline
-            unsigned int exec_size = 0;
-            for(const auto& file : external_files) {
-                if(file.program_name == program_name) {
-                    exec_size = file.size;
-                    break;
-                }
-            }
+    text_log_sink sink(execution_file.c_str(), status_file.c_str(), context.vectors, mode);
+    if(!sink.is_open()) {
+        std::cerr << "Error opening file!" << std::endl;
+        return false;
+    }
 
-            // Find available partition using BEST FIT algorithm - DECLARE OUTSIDE IF BLOCK
-            int avail_exec_partition = -1;
-            int best_fit_size = 1000000;
-            for(int j = 0; j < 6; j++) {
-                if(memory[j].code == "empty" && memory[j].size >= exec_size) {
-                    int wasted_space = memory[j].size - exec_size;
-                    if(wasted_space < best_fit_size) {
-                        best_fit_size = wasted_space;
-                        avail_exec_partition = memory[j].partition_number;
-                    }
-                }
-            }
+    checkpointer saver(trace, sink, checkpoint_prefix, checkpoints.interval, checkpoints.steps);
+    std::string error;
+    if(!simulate(trace, context, options, sink, error, &saver, resume.get())) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    sink.flush();
 
-            if (exec_size == 0) {
-                execution += std::to_string(current_time) + ", EXEC ERROR: Program not found\n";
-            } else if (avail_exec_partition == -1) {
-                execution += std::to_string(current_time) + ", EXEC ERROR: No available partition\n";
-            } else {
-                execution += std::to_string(current_time) + ", " + std::to_string(duration_intr) + ", Program is " 
-                                                                + std::to_string(exec_size) + " Mb large\n";
-                current_time += duration_intr;
-
-                execution += std::to_string(current_time) + ", " + std::to_string(exec_size * 15) + ", loading program into memory\n";
-                current_time += (exec_size * 15);
-
-                execution += std::to_string(current_time) + ", 3, marking partition as occupied\n";
-                current_time += 3;
-
-                execution += std::to_string(current_time) + ", 6, updating PCB\n";
-                current_time += 6;
-
-                // Free old partition and mark new partition
-                memory[current.partition_number - 1].code = "empty";
-                memory[avail_exec_partition - 1].code = program_name;
-
-                execution += std::to_string(current_time) + ", 0, scheduler called\n";
-                execution += std::to_string(current_time) + ", 1, IRET\n";
-                current_time += 1;
-
-                ///////////////////////////////////////////////////////////////////////////////////////////
-                
-                
-                // Create exec'd PCB with new program name and size
-                PCB exec_running_pcb(current.PID, current.PPID, program_name, exec_size, avail_exec_partition);
-                
-                // Use helper function to append system status
-                append_system_status(system_status, current_time, "EXEC", duration_intr, 
-                                   exec_running_pcb, wait_queue);
-                
-                ///////////////////////////////////////////////////////////////////////////////////////////
+    std::cout << "Output generated in " + execution_file + " and " + status_file + "\n" << std::flush;
+    return true;
+}
 
-            }
+//Same as run_simulation, but writes a binary event log for log_renderer to turn into text
+bool run_binary_simulation(const compiled_trace& trace, const simulation_context& context,
+                           const simulation_options& options, const std::string& log_file) {
 
-            ///////////////////////////////////////////////////////////////////////////////////////////
+    binary_log_sink sink(log_file.c_str(), context.vectors);
+    if(!sink.is_open()) {
+        std::cerr << "Error opening file!" << std::endl;
+        return false;
+    }
 
-            std::ifstream exec_trace_file(program_name + ".txt");
+    std::string error;
+    if(!simulate(trace, context, options, sink, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    sink.flush();
+    if(!sink.error().empty()) {
+        std::cerr << "Error: " << log_file << ": " << sink.error() << std::endl;
+        return false;
+    }
 
-            std::vector<std::string> exec_traces;
-            std::string exec_trace;
-            while(std::getline(exec_trace_file, exec_trace)) {
-                exec_traces.push_back(exec_trace);
-            }
+    std::cout << "Output generated in " + log_file + "\n" << std::flush;
+    return true;
+}
 
-            ///////////////////////////////////////////////////////////////////////////////////////////
-            //With the exec's trace (i.e. trace of external program), run the exec (HINT: think recursion)
-
-            if(exec_size != 0 && avail_exec_partition != -1) {
-                PCB exec_pcb(current.PID, current.PPID, program_name, exec_size, avail_exec_partition);
-                
-                // Create exec_wait_queue without current process
-                std::vector<PCB> exec_wait_queue;
-                for (const auto& pcb : wait_queue) {
-                    if (pcb.PID != current.PID) {
-                        exec_wait_queue.push_back(pcb);
-                    }
-                }
-                
-                auto [exec_execution, exec_status, exec_time] = simulate_trace(
-                    exec_traces, current_time, vectors, delays, external_files, 
-                    exec_pcb, exec_wait_queue);
-                execution += exec_execution;
-                system_status += exec_status;
-                current_time = exec_time;
-                
-                memory[avail_exec_partition - 1].code = "empty";
-            }
+//Runs the simulation for its statistics only (see stats_sink) and writes them to 'stats_file'
+bool run_stats_simulation(const compiled_trace& trace, const simulation_context& context,
+                          const simulation_options& options, const std::string& stats_file) {
+
+    std::ofstream output_file(stats_file);
+    if(!output_file.is_open()) {
+        std::cerr << "Error opening file!" << std::endl;
+        return false;
+    }
+
+    stats_sink sink(context.delays, context.partitions);
+    if(options.coalesce_window >= 0) {
+        sink.report_coalescing();
+    }
+    std::string error;
+    if(!simulate(trace, context, options, sink, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    sink.report(output_file);
+
+    std::cout << "Output generated in " + stats_file + "\n" << std::flush;
+    return true;
+}
+
+//Runs the simulation into a timeline_sink and writes its analysis to 'analysis_file'
+bool run_analysis_simulation(const compiled_trace& trace, const simulation_context& context,
+                             const simulation_options& options, const std::string& analysis_file) {
+
+    std::ofstream output_file(analysis_file);
+    if(!output_file.is_open()) {
+        std::cerr << "Error opening file!" << std::endl;
+        return false;
+    }
+
+    timeline_sink sink;
+    std::string error;
+    if(!simulate(trace, context, options, sink, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    report_timeline(output_file, analyze_timeline(sink));
+
+    std::cout << "Output generated in " + analysis_file + "\n" << std::flush;
+    return true;
+}
 
-            ///////////////////////////////////////////////////////////////////////////////////////////
+//Runs every job of a manifest in this process, on 'threads' worker threads (0 for one
+//per core). All files are loaded (and checked) before the first job runs; jobs naming
+//the same file share what was loaded, and each job has its own memory and output files.
+int run_batch(const char* manifest, unsigned int threads) {
+    table_cache tables;
+    std::vector<batch_job> jobs = load_manifest(manifest);
+
+    std::vector<simulation_context> contexts;
+    contexts.reserve(jobs.size());
+    for (const auto& job : jobs) {
+        contexts.push_back(tables.context(job.vector_file, job.device_file,
+                                          job.external_files_file, job.partition_file));
+        tables.trace(job.trace_file);
+    }
+    tables.load_programs();
+
+    //the cache is only read from here on, so the workers can share it
+    std::atomic<size_t> failed(0);
+    work_stealing_executor executor(threads);
+    executor.run(jobs.size(), [&](size_t i) {
+        if(!run_simulation(tables.trace(jobs[i].trace_file), contexts[i], simulation_options(),
+                           jobs[i].output_prefix + "execution.txt",
+                           jobs[i].output_prefix + "system_status.txt")) {
+            failed++;
+        }
+    });
+
+    std::cout << jobs.size() - failed << " of " << jobs.size() << " job(s) completed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+/**
+ * \brief runs a parameter sweep (see load_sweep) of a trace
+ *
+ * Every configuration starts from the tables on the command line. The simulation only
+ * runs once per partition table, in parallel on 'threads' worker threads (0 for one
+ * per core): delays and the context save time never change what it does, so their
+ * configurations are worked out from that run (see structure_sink).
+ *
+ * @param tables the tables loaded for the command line
+ * @param argv the command line: trace, vector table, device table, external files and
+ *             optionally the partition table
+ * @param partition_file the partition table on the command line, empty for the default
+ * @param options how the simulation runs; main only lets through the standard costs of
+ *                a run to completion simulation, the model structure_sink works out
+ * @param spec what to vary
+ * @param threads worker threads
+ * @param results_file where the results go, one line per configuration
+ * @return the exit code
+ *
+ */
+int run_sweep(table_cache& tables, char** argv, const std::string& partition_file, const simulation_options& options,
+              const sweep_spec& spec, unsigned int threads, const std::string& results_file) {
+    const std::vector<std::string> partition_tables = spec.partition_tables.empty()
+                                                      ? std::vector<std::string>{partition_file} : spec.partition_tables;
+    const std::vector<std::string> device_tables = spec.device_tables.empty()
+                                                   ? std::vector<std::string>{argv[3]} : spec.device_tables;
+    const std::vector<int> delay_scales = spec.delay_scales.empty() ? std::vector<int>{100} : spec.delay_scales;
+    const std::vector<int> context_saves = spec.context_saves.empty()
+                                           ? std::vector<int>{standard_kernel_costs::context_save} : spec.context_saves;
+
+    //everything is loaded (and checked) before the first run, and the trace compiled once
+    const compiled_trace& trace = tables.trace(argv[1]);
+    std::vector<simulation_context> contexts;
+    for(const auto& partitions : partition_tables) {
+        contexts.push_back(tables.context(argv[2], argv[3], argv[4], partitions));
+    }
+    for(const auto& devices : device_tables) {
+        tables.device_table(devices);
+    }
+    tables.load_programs();
+
+    std::vector<structure_sink> structures(contexts.size());
+    std::vector<std::string> errors(contexts.size());
+    work_stealing_executor executor(threads);
+    executor.run(contexts.size(), [&](size_t i) {
+        simulate(trace, contexts[i], options, structures[i], errors[i]);
+    });
+    for(size_t i = 0; i < contexts.size(); i++) {
+        if(!errors[i].empty()) {
+            std::cerr << "Error: " << (partition_tables[i].empty() ? "default" : partition_tables[i]) << ": "
+                      << errors[i] << std::endl;
+            return 1;
+        }
+    }
 
-            break; //Why is this important? (answer in report)
+    std::ofstream output_file(results_file);
+    if(!output_file.is_open()) {
+        std::cerr << "Error opening file!" << std::endl;
+        return 1;
+    }
 
+    size_t configurations = 0;
+    output_file << "partition_table,device_table,delay_scale,context_save,total_time,allocation_failures\n";
+    for(size_t i = 0; i < contexts.size(); i++) {
+        const structure_sink& run = structures[i];
+        for(const auto& devices : device_tables) {
+            const std::vector<int>& delays = tables.device_table(devices);
+            if(run.last_device() >= (int)delays.size()) {
+                std::cerr << "Error: " << devices << " has no delay for device " << run.last_device() << std::endl;
+                return 1;
+            }
+            for(int scale : delay_scales) {
+                for(int context_save : context_saves) {
+                    output_file << (partition_tables[i].empty() ? "default" : partition_tables[i]) << ","
+                                << devices << "," << scale << "," << context_save << ","
+                                << run.total_time(contexts[i].delays, delays, scale, context_save) << ","
+                                << run.failures() << "\n";
+                    configurations++;
+                }
+            }
         }
     }
 
-    return {execution, system_status, current_time};
+    std::cout << configurations << " configuration(s) from " << contexts.size() << " run(s); output generated in "
+              << results_file << std::endl;
+    return 0;
 }
 
 int main(int argc, char** argv) {
 
+    //--batch <manifest> [--jobs=N], the same --jobs=N as a sweep takes
+    if(argc >= 3 && std::string_view(argv[1]) == "--batch") {
+        int threads = 0;
+        if(argc > 4 || (argc == 4 && (std::string_view(argv[3]).substr(0, 7) != "--jobs="
+                                      || !parse_int(std::string_view(argv[3]).substr(7), threads) || threads < 0))) {
+            std::cerr << "Error: expected --jobs=<number of threads>" << std::endl;
+            exit(1);
+        }
+        return run_batch(argv[2], threads);
+    }
+
+    //context holds the tables shared by the whole simulation:
     //vectors is a C++ std::vector of strings that contain the address of the ISR
     //delays  is a C++ std::vector of ints that contain the delays of each device
     //the index of these elements is the device number, starting from 0
     //external_files is a C++ std::vector of the struct 'external_file'. Check the struct in 
     //interrupt.hpp to know more.
-    auto [vectors, delays, external_files] = parse_args(argc, argv);
-    std::ifstream input_file(argv[1]);
+    //programs has the trace of every external file, compiled on its first EXEC.
+    //options come after the files: --binary-log writes a binary event log instead of
+    //the text logs, --stats only the statistics of the simulation, --analyze the busy
+    //time, interrupt latencies and device utilization of its timeline, --status-deltas[=N]
+    //the system status as deltas (in full every N tables), --costs picks the kernel
+    //cost model, --io=overlapped lets devices work while other processes run and
+    //--scheduler (with --quantum) picks the process that runs, --cores=N runs N cores
+    //with a run queue each (see simulate_multicore), --coalesce-end-io=W lets END_IOs of
+    //a device within W of its interrupt share it (see coalesce_end_ios); --memoize-exec replays
+    //programs exec'd again in the same state, and --sweep=<file> runs a parameter sweep
+    //instead (see run_sweep), on --jobs=N threads. --checkpoint-every=N and
+    //--checkpoint-at=<steps> take checkpoints of the run (see checkpointer) and
+    //--resume=<checkpoint> goes on from one
+    simulation_options options;
+    checkpoint_options checkpoints;
+    std::string sweep_file;
+    int sweep_threads = 0;
+    bool binary_log = false;
+    bool stats = false;
+    bool analyze = false;
+    int delta_interval = -1;
+    while(argc > 1 && std::string_view(argv[argc - 1]).substr(0, 2) == "--") {
+        std::string_view option = argv[--argc];
+        if(option == "--binary-log") {
+            binary_log = true;
+        } else if(option == "--stats") {
+            stats = true;
+        } else if(option == "--analyze") {
+            analyze = true;
+        } else if(option == "--status-deltas") {
+            delta_interval = 0;
+        } else if(option.substr(0, 16) == "--status-deltas=") {
+            if(!parse_int(option.substr(16), delta_interval) || delta_interval < 0) {
+                std::cerr << "Error: expected --status-deltas=<tables between full tables>" << std::endl;
+                exit(1);
+            }
+        } else if(option == "--costs=standard") {
+            options.costs = kernel_cost_model::STANDARD;
+        } else if(option == "--costs=hardware-save") {
+            options.costs = kernel_cost_model::HARDWARE_SAVE;
+        } else if(option == "--io=serial") {
+            options.io = io_model::SERIAL;
+        } else if(option == "--io=overlapped") {
+            options.io = io_model::OVERLAPPED;
+        } else if(option.substr(0, 8) == "--sweep=") {
+            sweep_file = std::string(option.substr(8));
+        } else if(option.substr(0, 7) == "--jobs=") {
+            if(!parse_int(option.substr(7), sweep_threads) || sweep_threads < 0) {
+                std::cerr << "Error: expected --jobs=<number of threads>" << std::endl;
+                exit(1);
+            }
+        } else if(option == "--memoize-exec") {
+            options.memoize_exec = true;
+        } else if(option == "--scheduler=fcfs") {
+            options.scheduler = scheduling_policy::FCFS;
+        } else if(option == "--scheduler=rr") {
+            options.scheduler = scheduling_policy::ROUND_ROBIN;
+        } else if(option == "--scheduler=priority") {
+            options.scheduler = scheduling_policy::PRIORITY;
+        } else if(option == "--scheduler=mlfq") {
+            options.scheduler = scheduling_policy::MULTILEVEL_FEEDBACK;
+        } else if(option.substr(0, 8) == "--cores=") {
+            if(!parse_int(option.substr(8), options.cores) || options.cores < 1 || options.cores > 0xFFFF) {
+                std::cerr << "Error: expected --cores=<number of cores>" << std::endl;
+                exit(1);
+            }
+        } else if(option.substr(0, 19) == "--checkpoint-every=") {
+            int interval = 0;
+            if(!parse_int(option.substr(19), interval) || interval < 1) {
+                std::cerr << "Error: expected --checkpoint-every=<instructions between checkpoints>" << std::endl;
+                exit(1);
+            }
+            checkpoints.interval = interval;
+        } else if(option.substr(0, 16) == "--checkpoint-at=") {
+            std::vector<int> steps;
+            if(!parse_sweep_values(option.substr(16), steps) || steps.empty()
+               || *std::min_element(steps.begin(), steps.end()) < 1) {
+                std::cerr << "Error: expected --checkpoint-at=<instruction counts, or lo..hi[:step] ranges>" << std::endl;
+                exit(1);
+            }
+            checkpoints.steps.insert(checkpoints.steps.end(), steps.begin(), steps.end());
+        } else if(option.substr(0, 9) == "--resume=") {
+            checkpoints.resume = std::string(option.substr(9));
+        } else if(option.substr(0, 18) == "--coalesce-end-io=") {
+            if(!parse_int(option.substr(18), options.coalesce_window) || options.coalesce_window < 0) {
+                std::cerr << "Error: expected --coalesce-end-io=<window>" << std::endl;
+                exit(1);
+            }
+        } else if(option.substr(0, 10) == "--quantum=") {
+            if(!parse_int(option.substr(10), options.quantum) || options.quantum < 1) {
+                std::cerr << "Error: expected --quantum=<time slice>" << std::endl;
+                exit(1);
+            }
+        } else {
+            std::cerr << "Error: unknown option " << option << std::endl;
+            exit(1);
+        }
+    }
 
-    //Just a sanity check to know what files you have
-    print_external_files(external_files);
+    //each of these replaces the text logs with output of its own, so only one can be given
+    if((int)stats + (int)analyze + (int)binary_log + (int)(delta_interval >= 0) > 1) {
+        std::cerr << "Error: --binary-log, --stats, --analyze and --status-deltas are alternatives; give at most one"
+                  << std::endl;
+        exit(1);
+    }
 
-    //Make initial PCB (notice how partition is not assigned yet)
-    PCB current(0, -1, "init", 1, -1);
-    //Update memory (partition is assigned here, you must implement this function)
-    if(!allocate_memory(&current)) {
-        std::cerr << "ERROR! Memory allocation failed!" << std::endl;
+    //a sweep works every configuration out of one run of the standard, run to completion
+    //model (see structure_sink); anything else would need a run per configuration
+    if(!sweep_file.empty() && (options.costs != kernel_cost_model::STANDARD || options.coalesce_window >= 0
+                               || options.io == io_model::OVERLAPPED || options.cores > 1
+                               || options.scheduler != scheduling_policy::RUN_TO_COMPLETION
+                               || stats || analyze || binary_log || delta_interval >= 0)) {
+        std::cerr << "Error: --sweep only works with the standard costs of a run to completion simulation "
+                     "(no --costs=hardware-save, --coalesce-end-io, --scheduler, --io=overlapped, --cores, "
+                     "--binary-log, --stats, --analyze or --status-deltas)" << std::endl;
+        exit(1);
     }
 
-    std::vector<PCB> wait_queue;
+    //exec_memo replays whole runs of a program, which only the run to completion engine has
+    if(options.memoize_exec && (options.io == io_model::OVERLAPPED || options.cores > 1
+                                || options.scheduler != scheduling_policy::RUN_TO_COMPLETION)) {
+        std::cerr << "Error: --memoize-exec only works with a run to completion simulation "
+                     "(no --scheduler, --io=overlapped or --cores)" << std::endl;
+        exit(1);
+    }
 
-    /******************ADD YOUR VARIABLES HERE*************************/
-    // All helper logic is now inlined in simulate_trace
+    if(checkpoints.enabled() && (stats || analyze || binary_log || delta_interval >= 0 || !sweep_file.empty()
+                                 || options.io == io_model::OVERLAPPED || options.cores > 1
+                                 || options.scheduler != scheduling_policy::RUN_TO_COMPLETION)) {
+        std::cerr << "Error: checkpoints only work with the text logs of a run to completion simulation" << std::endl;
+        exit(1);
+    }
 
-    /******************************************************************/
+    table_cache tables;
+    const simulation_context context = parse_args(argc, argv, tables);
 
-    //Converting the trace file into a vector of strings.
-    std::vector<std::string> trace_file;
-    std::string trace;
-    while(std::getline(input_file, trace)) {
-        trace_file.push_back(trace);
+    if(!sweep_file.empty()) {
+        return run_sweep(tables, argv, argc == 6 ? argv[5] : "", options, load_sweep(sweep_file), sweep_threads,
+                         "output_files/sweep_5.txt");
     }
 
-    auto [execution, system_status, _] = simulate_trace(trace_file, 
-                                            0, 
-                                            vectors, 
-                                            delays,
-                                            external_files, 
-                                            current, 
-                                            wait_queue);
+    //Just a sanity check to know what files you have
+    print_external_files(context.external_files);
 
-    input_file.close();
+    /******************ADD YOUR VARIABLES HERE*************************/
+    // All helper logic is now inlined in simulate_trace
+
+    /******************************************************************/
+
+    //Read and compile the trace file once; the simulation only ever looks at the compiled form
+    const compiled_trace& trace = tables.trace(argv[1]);
 
-    write_output(execution, "output_files/execution_5.txt");
-    write_output(system_status, "output_files/system_status_5.txt");
+    if(stats) {
+        if(!run_stats_simulation(trace, context, options, "output_files/stats_5.txt")) {
+            exit(1);
+        }
+    } else if(analyze) {
+        if(!run_analysis_simulation(trace, context, options, "output_files/analysis_5.txt")) {
+            exit(1);
+        }
+    } else if(binary_log) {
+        if(!run_binary_simulation(trace, context, options, "output_files/events_5.bin")) {
+            exit(1);
+        }
+    } else if(checkpoints.enabled()) {
+        if(!run_checkpointed_simulation(trace, context, options, checkpoints, "output_files/execution_5.txt",
+                                        "output_files/system_status_5.txt", "output_files/checkpoint_5")) {
+            exit(1);
+        }
+    } else if(delta_interval >= 0) {
+        if(!run_simulation(trace, context, options, "output_files/execution_5.txt",
+                           "output_files/system_status_delta_5.txt", delta_interval)) {
+            exit(1);
+        }
+    } else if(!run_simulation(trace, context, options, "output_files/execution_5.txt",
+                              "output_files/system_status_5.txt")) {
+        exit(1);
+    }
 
     return 0;
-}
\ No newline at end of file
+}
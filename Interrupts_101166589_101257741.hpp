@@ -4,13 +4,143 @@
 #include<iostream>
 #include<fstream>
 #include<string>
+#include<string_view>
+#include<charconv>
+#include<array>
 #include<vector>
+#include<tuple>
+#include<map>
+#include<unordered_map>
+#include<set>
+#include<cstdint>
+#include<climits>
 #include<random>
 #include<utility>
 #include<sstream>
 #include<iomanip>
 #include <algorithm>
 #include<stdio.h>
+#include<cstring>
+#include<iterator>
+#if defined(__unix__) || defined(__APPLE__)
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<deque>
+#include<queue>
+#include<memory>
+#include<memory_resource>
+#include<filesystem>
+#include<functional>
+#include<atomic>
+#include<ctype.h>
+
+#ifdef INTERRUPTS_PROFILE
+#include<chrono>
+#include<cstdlib>
+
+//Where the profile goes: $INTERRUPTS_PROFILE_FILE when it is set, otherwise this, which
+//a build can change with -DINTERRUPTS_PROFILE_FILE=...
+#ifndef INTERRUPTS_PROFILE_FILE
+#define INTERRUPTS_PROFILE_FILE "profile.json"
+#endif
+
+//What the instrumentation times; a phase inside another one counts in both
+enum class profile_phase { PARSE, PARTITION_SEARCH, PROGRAM_LOAD, FORMAT, WRITE_OUTPUT, COUNT };
+
+//What it counts; MAX_DEPTH is a high-water mark of the frames of simulate_trace (the
+//live processes of simulate_scheduled), the rest are totals
+enum class profile_counter { ALLOCATIONS, FAILED_ALLOCATIONS, FORKS, EXECS, MAX_DEPTH, BYTES_EMITTED, COUNT };
+
+/**
+ * \brief the times and counters of a profiling build, written as JSON at exit
+ *
+ * Only built with -DINTERRUPTS_PROFILE; everything else goes through the PROFILE_*
+ * macros, which are empty otherwise. Safe to update from the batch worker threads.
+ */
+class profiler {
+public:
+    static profiler& instance() {
+        static profiler profile;
+        return profile;
+    }
+
+    void add_time(profile_phase phase, std::uint64_t nanoseconds) {
+        phases[(size_t)phase].calls.fetch_add(1, std::memory_order_relaxed);
+        phases[(size_t)phase].nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    void add(profile_counter counter, std::uint64_t amount) {
+        counters[(size_t)counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    void at_least(profile_counter counter, std::uint64_t value) {
+        std::atomic<std::uint64_t>& mark = counters[(size_t)counter];
+        std::uint64_t seen = mark.load(std::memory_order_relaxed);
+        while(seen < value && !mark.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    }
+
+    ~profiler() {
+        static const char* phase_names[] = {"parse", "partition_search", "program_load", "format", "write_output"};
+        static const char* counter_names[] = {"allocations", "failed_allocations", "forks", "execs",
+                                              "max_depth", "bytes_emitted"};
+
+        const char* filename = std::getenv("INTERRUPTS_PROFILE_FILE");
+        std::ofstream out(filename && *filename ? filename : INTERRUPTS_PROFILE_FILE);
+        std::ostream& json = out.is_open() ? out : std::cerr;
+
+        json << "{\n  \"phases\": {";
+        for(size_t i = 0; i < (size_t)profile_phase::COUNT; i++) {
+            json << (i ? "," : "") << "\n    \"" << phase_names[i] << "\": {\"calls\": " << phases[i].calls
+                 << ", \"seconds\": " << std::fixed << std::setprecision(6) << phases[i].nanoseconds / 1e9 << "}";
+        }
+        json << "\n  },\n  \"counters\": {";
+        for(size_t i = 0; i < (size_t)profile_counter::COUNT; i++) {
+            json << (i ? "," : "") << "\n    \"" << counter_names[i] << "\": " << counters[i];
+        }
+        json << "\n  }\n}\n";
+    }
+
+private:
+    struct phase_stats {
+        std::atomic<std::uint64_t>  calls{0};
+        std::atomic<std::uint64_t>  nanoseconds{0};
+    };
+
+    std::array<phase_stats, (size_t)profile_phase::COUNT>                   phases;
+    std::array<std::atomic<std::uint64_t>, (size_t)profile_counter::COUNT>  counters{};
+};
+
+//Times the rest of the enclosing scope as 'phase'
+class profile_scope {
+public:
+    explicit profile_scope(profile_phase phase): phase(phase), start(std::chrono::steady_clock::now()) {}
+
+    ~profile_scope() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        profiler::instance().add_time(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+private:
+    profile_phase                           phase;
+    std::chrono::steady_clock::time_point   start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase) profile_scope PROFILE_CONCAT(profile_scope_, __LINE__)(profile_phase::phase)
+#define PROFILE_COUNT(counter, amount) profiler::instance().add(profile_counter::counter, (amount))
+#define PROFILE_MAX(counter, value) profiler::instance().at_least(profile_counter::counter, (value))
+#else
+#define PROFILE_SCOPE(phase)
+#define PROFILE_COUNT(counter, amount)
+#define PROFILE_MAX(counter, value)
+#endif
 
 #define ADDR_BASE   0
 #define VECTOR_SIZE 2
@@ -18,19 +148,142 @@
 struct memory_partition_t {
     const unsigned int partition_number;
     const unsigned int size;
-    std::string code;
 
-    memory_partition_t(unsigned int _pn, unsigned int _s, std::string _c):
-        partition_number(_pn), size(_s), code(_c) {}
+    memory_partition_t(unsigned int _pn, unsigned int _s):
+        partition_number(_pn), size(_s) {}
+};
+
+//Partition table used when no partition file is given
+std::vector<memory_partition_t> default_partitions();
+
+/**
+ * \brief memory for what one simulation allocates and frees over and over
+ *
+ * Blocks are carved out of large chunks and recycled through pools by size, so once
+ * the containers of a simulation have grown, FORK and EXEC never reach malloc. It
+ * only gives its memory back when it is destroyed, and is not thread safe: every
+ * simulation has its own, and it has to outlive what uses it.
+ */
+class simulation_arena {
+public:
+    explicit simulation_arena(std::size_t initial_size = 64 * 1024): chunks(initial_size), pools(&chunks) {}
+
+    simulation_arena(const simulation_arena&) = delete;
+    simulation_arena& operator=(const simulation_arena&) = delete;
+
+    std::pmr::memory_resource* resource() {
+        return &pools;
+    }
+
+private:
+    std::pmr::monotonic_buffer_resource     chunks;
+    std::pmr::unsynchronized_pool_resource  pools;
 };
 
-memory_partition_t memory[] = {
-    memory_partition_t(1, 40, "empty"),
-    memory_partition_t(2, 25, "empty"),
-    memory_partition_t(3, 15, "empty"),
-    memory_partition_t(4, 10, "empty"),
-    memory_partition_t(5, 8, "empty"),
-    memory_partition_t(6, 2, "empty")
+/**
+ * \brief the memory partitions and which of them are in use
+ *
+ * Free partitions are kept in a set ordered by (size, partition number), so a best
+ * fit allocation is one lower_bound and a free is one insert. Occupancy is a bitmap
+ * indexed by partition number - 1. The nodes of the set come from 'arena', if given.
+ */
+class partition_manager {
+public:
+    partition_manager() = default;
+
+    explicit partition_manager(const std::vector<memory_partition_t>& table,
+                               std::pmr::memory_resource* arena = std::pmr::get_default_resource()):
+        free_set(arena) {
+        for (const auto& partition : table) {
+            sizes.push_back(partition.size);
+        }
+        occupied.assign((sizes.size() + 63) / 64, 0);
+        for (size_t i = 0; i < sizes.size(); i++) {
+            free_set.emplace(sizes[i], i + 1);
+        }
+    }
+
+    //Best fit: takes the smallest free partition of at least 'size', the lowest numbered
+    //one on ties. Returns the partition number, or -1 if nothing fits.
+    int allocate(unsigned int size) {
+        PROFILE_SCOPE(PARTITION_SEARCH);
+        PROFILE_COUNT(ALLOCATIONS, 1);
+        auto it = free_set.lower_bound({size, 0});
+        if(it == free_set.end()) {
+            PROFILE_COUNT(FAILED_ALLOCATIONS, 1);
+            return -1;
+        }
+
+        int partition_number = it->second;
+        free_set.erase(it);
+        set_occupied(partition_number, true);
+        return partition_number;
+    }
+
+    //Returns the partition to the free set; freeing a free or unknown partition does nothing
+    void free(int partition_number) {
+        if(is_free(partition_number)) {
+            return;
+        }
+
+        set_occupied(partition_number, false);
+        free_set.emplace(sizes[partition_number - 1], partition_number);
+    }
+
+    //True for partitions that are not in use, or do not exist
+    bool is_free(int partition_number) const {
+        if(partition_number < 1 || (size_t)partition_number > sizes.size()) {
+            return true;
+        }
+        size_t i = partition_number - 1;
+        return !(occupied[i / 64] >> (i % 64) & 1);
+    }
+
+    size_t count() const {
+        return sizes.size();
+    }
+
+    unsigned int size(int partition_number) const {
+        return sizes[partition_number - 1];
+    }
+
+    //One bit per partition, set while it is occupied
+    const std::vector<std::uint64_t>& occupancy() const {
+        return occupied;
+    }
+
+    //Occupies and frees partitions until the occupancy is the given one
+    void set_occupancy(const std::vector<std::uint64_t>& bits) {
+        for(size_t word = 0; word < occupied.size(); word++) {
+            std::uint64_t changed = occupied[word] ^ bits[word];
+            for(int bit = 0; changed != 0; bit++, changed >>= 1) {
+                if(!(changed & 1)) {
+                    continue;
+                }
+                int partition_number = word * 64 + bit + 1;
+                if(is_free(partition_number)) {
+                    free_set.erase({sizes[partition_number - 1], partition_number});
+                    set_occupied(partition_number, true);
+                } else {
+                    free(partition_number);
+                }
+            }
+        }
+    }
+
+private:
+    void set_occupied(int partition_number, bool value) {
+        size_t i = partition_number - 1;
+        if(value) {
+            occupied[i / 64] |= std::uint64_t(1) << (i % 64);
+        } else {
+            occupied[i / 64] &= ~(std::uint64_t(1) << (i % 64));
+        }
+    }
+
+    std::vector<unsigned int>                   sizes;      //!< size of each partition
+    std::vector<std::uint64_t>                  occupied;   //!< one bit per partition
+    std::pmr::set<std::pair<unsigned int, int>> free_set;   //!< (size, partition number)
 };
 
 struct PCB{
@@ -49,407 +302,4259 @@ struct external_file{
     unsigned int    size;
 };
 
-//Allocates a program to memory (if there is space)
+//Allocates a program to memory (if there is space), using best fit
 //returns true if the allocation was sucessful, false if not.
-bool allocate_memory(PCB* current) {
-    for(int i = 5; i >= 0; i--) { //Start from smallest partition
-        //check is the code will fit and if the partition is empty
-        if(memory[i].size >= current->size && memory[i].code == "empty") {
-            current->partition_number = memory[i].partition_number;
-            memory[i].code = current->program_name;
-            return true;
+bool allocate_memory(partition_manager& memory, PCB* current);
+
+//frees the memory given PCB.
+void free_memory(partition_manager& memory, PCB* process);
+
+/**
+ * \brief program names mapped to small ids
+ *
+ * Traces, the program registry and the process table all refer to programs by these
+ * ids, so the simulation stores and compares ints. Names are added while the tables
+ * and traces load, which for an external program is its first EXEC (see
+ * program_registry); once everything is loaded, simulations running in parallel can
+ * share one. "init" is always id 0.
+ */
+class symbol_table {
+public:
+    symbol_table() {
+        intern("init");
+    }
+
+    //Id of a name, giving it one the first time it is seen
+    int intern(const std::string& name) {
+        auto [it, inserted] = ids.try_emplace(name, (int)names.size());
+        if(inserted) {
+            names.push_back(name);
         }
+        return it->second;
     }
-    return false;
-}
 
-//frees the memory given PCB.
-void free_memory(PCB* process) {
-    memory[process->partition_number - 1].code = "empty";
-    process->partition_number = -1;
-}
+    //Id of a name, or -1 if it has none
+    int find(const std::string& name) const {
+        auto it = ids.find(name);
+        return it == ids.end() ? -1 : it->second;
+    }
 
-// Following function was taken from stackoverflow; helper function for splitting strings
-std::vector<std::string> split_delim(std::string input, std::string delim) {
-    std::vector<std::string> tokens;
-    std::size_t pos = 0;
-    std::string token;
-    while ((pos = input.find(delim)) != std::string::npos) {
-        token = input.substr(0, pos);
-        tokens.push_back(token);
-        input.erase(0, pos + delim.length());
+    const std::string& name(int id) const {
+        return names[id];
     }
-    tokens.push_back(input);
 
-    return tokens;
-}
+    size_t size() const {
+        return names.size();
+    }
+
+private:
+    std::vector<std::string>                names;
+    std::unordered_map<std::string, int>    ids;
+};
 
 /**
- * \brief parse the CLI arguments
+ * \brief every process of a simulation, one column per PCB field
  *
- * This helper function parses command line arguments and checks for errors 
- * 
- * @param argc number of command line arguments
- * @param argv the command line arguments
- * @return a vector of strings (the parsed vector table), a vector of delays, a vector of external files
- * 
+ * A process is referred to by its slot, the row it has in every column; the slot of
+ * a process that is removed is handed out again. Programs are symbol ids, so copying,
+ * comparing or moving a process never touches a string.
  */
-std::tuple<std::vector<std::string>, std::vector<int>, std::vector<external_file>>parse_args(int argc, char** argv) {
-    if(argc != 5) {
-        std::cout << "ERROR!\nExpected 4 argument, received " << argc - 1 << std::endl;
-        std::cout << "To run the program, do: ./interrutps <your_trace_file.txt> <your_vector_table.txt> <your_device_table.txt> <your_external_files.txt>" << std::endl;
-        exit(1);
+class process_table {
+public:
+    explicit process_table(const symbol_table& symbols): symbols(symbols) {}
+
+    std::vector<unsigned int>   PID;
+    std::vector<int>            PPID;
+    std::vector<int>            program;            //!< symbol id of the program name
+    std::vector<unsigned int>   size;
+    std::vector<int>            partition_number;
+
+    //Adds a process and returns its slot
+    int add(unsigned int pid, int ppid, int program_id, unsigned int program_size, int partition) {
+        if(!free_slots.empty()) {
+            int slot = free_slots.back();
+            free_slots.pop_back();
+            set(slot, pid, ppid, program_id, program_size, partition);
+            return slot;
+        }
+
+        PID.push_back(pid);
+        PPID.push_back(ppid);
+        program.push_back(program_id);
+        size.push_back(program_size);
+        partition_number.push_back(partition);
+        return PID.size() - 1;
+    }
+
+    //Adds a process whose program name already has a symbol; -1 if it has none
+    int add(const PCB& pcb) {
+        int program_id = symbols.find(pcb.program_name);
+        if(program_id == -1) {
+            return -1;
+        }
+        return add(pcb.PID, pcb.PPID, program_id, pcb.size, pcb.partition_number);
+    }
+
+    void set(int slot, unsigned int pid, int ppid, int program_id, unsigned int program_size, int partition) {
+        PID[slot] = pid;
+        PPID[slot] = ppid;
+        program[slot] = program_id;
+        size[slot] = program_size;
+        partition_number[slot] = partition;
     }
 
-    std::ifstream input_file;
-    input_file.open(argv[1]);
-    if (!input_file.is_open()) {
-        std::cerr << "Error: Unable to open file: " << argv[1] << std::endl;
-        exit(1);
+    void remove(int slot) {
+        free_slots.push_back(slot);
     }
-    input_file.close();
 
-    input_file.open(argv[2]);
-    if (!input_file.is_open()) {
-        std::cerr << "Error: Unable to open file: " << argv[2] << std::endl;
-        exit(1);
+    //Slots of removed processes, the one handed out next last
+    const std::vector<int>& free_list() const {
+        return free_slots;
     }
 
-    std::string vector;
-    std::vector<std::string> vectors;
-    while(std::getline(input_file, vector)) {
-        vectors.push_back(vector);
+    void set_free_list(std::vector<int> slots) {
+        free_slots = std::move(slots);
     }
-    input_file.close();
 
-    std::string duration;
-    std::vector<int> delays;
-    input_file.open(argv[3]);
+    const std::string& program_name(int program_id) const {
+        return symbols.name(program_id);
+    }
 
-    if (!input_file.is_open()) {
-        std::cerr << "Error: Unable to open file: " << argv[3] << std::endl;
-        exit(1);
+    //The process as a PCB, for code that still works with those
+    PCB pcb(int slot) const {
+        return PCB(PID[slot], PPID[slot], symbols.name(program[slot]), size[slot], partition_number[slot]);
     }
 
-    while(std::getline(input_file, duration)) {
-        delays.push_back(std::stoi(duration));
+private:
+    std::vector<int>        free_slots;
+    const symbol_table&     symbols;
+};
+
+//Processes waiting on the running one, by slot, the most recent last. It remembers the
+//highest PID at or below every entry, so the next free PID is known without a scan.
+class process_queue {
+public:
+    void push(int slot, unsigned int pid) {
+        slots.push_back(slot);
+        max_pids.push_back(max_pids.empty() ? pid : std::max(pid, max_pids.back()));
     }
-    input_file.close();
 
-    std::vector<external_file> external_files;
-    input_file.open(argv[4]);
-    if (!input_file.is_open()) {
-        std::cerr << "Error: Unable to open file: " << argv[4] << std::endl;
-        exit(1);
+    void pop() {
+        slots.pop_back();
+        max_pids.pop_back();
     }
 
-    std::string file_content;
-    while(std::getline(input_file, file_content)) {
-        external_file entry;
-        auto file_info      = split_delim(file_content, ",");
+    bool empty() const { return slots.empty(); }
+    size_t size() const { return slots.size(); }
+    int operator[](size_t i) const { return slots[i]; }
+    const std::vector<int>& entries() const { return slots; }
 
-        entry.program_name  = file_info[0];
-        entry.size          = std::stoi(file_info[1]);
-        external_files.push_back(entry);
+    //Highest PID on the queue, 0 if it is empty
+    unsigned int max_pid() const {
+        return max_pids.empty() ? 0 : max_pids.back();
     }
 
-    input_file.close();
+private:
+    std::vector<int>            slots;
+    std::vector<unsigned int>   max_pids;
+};
 
+//Helper function for splitting strings without allocating. Returns the first N fields
+//of 'input' split on 'delim' as views into 'input'; 'count' is set to the number of
+//fields found (at most N). Missing fields are left empty.
+template<std::size_t N>
+std::array<std::string_view, N> split_delim(std::string_view input, char delim, std::size_t& count) {
+    std::array<std::string_view, N> tokens{};
+    count = 0;
+    while(count < N) {
+        std::size_t pos = input.find(delim);
+        tokens[count++] = input.substr(0, pos);
+        if(pos == std::string_view::npos) {
+            break;
+        }
+        input.remove_prefix(pos + 1);
+    }
 
-    return {vectors, delays, external_files};
+    return tokens;
 }
 
+//Parses a base 10 int the way std::stoi does (leading whitespace and sign allowed,
+//trailing characters ignored); returns false if there is no number or it overflows
+bool parse_int(std::string_view text, int& value);
+
 //Parces each trace and returns a tuple: {Tace activity, duration or interrupt number, program name (if applicable)}
-std::tuple<std::string, int, std::string> parse_trace(std::string trace) {
-    //split line by ','
-    auto parts = split_delim(trace, ",");
-    if (parts.size() < 2) {
-        std::cerr << "Error: Malformed input line: " << trace << std::endl;
-        return {"null", -1, "null"};
+//The activity and program name are views into 'trace', so it has to outlive them.
+std::tuple<std::string_view, int, std::string_view> parse_trace(std::string_view trace);
+
+//Opcodes of the compiled trace; anything simulate_trace does not act on becomes a NOP
+enum class trace_op : unsigned char {
+    NOP,
+    CPU,
+    SYSCALL,
+    END_IO,
+    FORK,
+    EXEC,
+    IF_CHILD,
+    IF_PARENT,
+    ENDIF
+};
+
+//One compiled trace line. 'arg' is the interned program id for EXEC and the index
+//into the fork table for FORK; 'line' is the index of the source line.
+struct trace_instr {
+    trace_op        op;
+    int             operand;
+    int             arg;
+    unsigned int    line;
+};
+
+//Precomputed jump targets of a FORK: the block holding the child's trace and the
+//index (within the forking block) the parent resumes from
+struct fork_target {
+    int child_block;
+    int parent_index;
+};
+
+//Where a block's instructions are in the code of a compiled trace
+struct block_range {
+    std::uint64_t   offset;
+    std::uint64_t   count;
+};
+
+//A run of instructions, e.g. one block of a compiled trace
+struct instr_span {
+    const trace_instr*  first;
+    size_t              count;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const trace_instr& operator[](size_t i) const { return first[i]; }
+};
+
+//A read-only view of a whole file, memory mapped where the platform allows it and
+//read into memory otherwise
+class mapped_file {
+public:
+    mapped_file() = default;
+
+    mapped_file(mapped_file&& other) noexcept {
+        *this = std::move(other);
     }
 
-    auto activity = parts[0];
-    auto duration_intr = std::stoi(parts[1]);
-    std::string extern_file = "null";
+    mapped_file& operator=(mapped_file&& other) noexcept {
+        if(this != &other) {
+            unmap();
+            address = other.address;
+            length = other.length;
+            copy = std::move(other.copy);
+            other.address = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
 
-    auto exec = split_delim(parts[0], " ");
-    if(exec[0] == "EXEC") {
-        extern_file = exec[1];
-        activity = "EXEC";
+    ~mapped_file() {
+        unmap();
     }
 
-    return {activity, duration_intr, extern_file};
-}
+    //Returns false if the file cannot be opened or is empty
+    bool open(const std::string& filename) {
+        unmap();
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if(fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if(fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping != MAP_FAILED) {
+                address = mapping;
+                length = info.st_size;
+            }
+        }
+        ::close(fd);
+        return address != nullptr;
+#else
+        std::ifstream input_file(filename, std::ios::binary);
+        copy.assign(std::istreambuf_iterator<char>(input_file), std::istreambuf_iterator<char>());
+        length = copy.size();
+        return length > 0;
+#endif
+    }
 
-//Default interrupt boilerplate
-std::pair<std::string, int> intr_boilerplate(int current_time, int intr_num, int context_save_time, std::vector<std::string> vectors) {
+    const char* data() const {
+        return address != nullptr ? (const char*)address : copy.data();
+    }
 
-    std::string execution = "";
+    size_t size() const {
+        return length;
+    }
 
-    execution += std::to_string(current_time) + ", " + std::to_string(1) + ", switch to kernel mode\n";
-    current_time++;
+private:
+    void unmap() {
+#if defined(__unix__) || defined(__APPLE__)
+        if(address != nullptr) {
+            munmap(address, length);
+        }
+#endif
+        address = nullptr;
+        length = 0;
+        copy.clear();
+    }
 
-    execution += std::to_string(current_time) + ", " + std::to_string(context_save_time) + ", context saved\n";
-    current_time += context_save_time;
-    
-    char vector_address_c[10];
-    sprintf(vector_address_c, "0x%04X", (ADDR_BASE + (intr_num * VECTOR_SIZE)));
-    std::string vector_address(vector_address_c);
+    void*               address = nullptr;
+    size_t              length = 0;
+    std::vector<char>   copy;
+};
 
-    execution += std::to_string(current_time) + ", " + std::to_string(1) + ", find vector " + std::to_string(intr_num) 
-                    + " in memory position " + vector_address + "\n";
-    current_time++;
+/**
+ * \brief a text file read a chunk at a time and handed out line by line
+ *
+ * While the lines of one chunk are handed out, a prefetch thread reads the next one,
+ * so whatever consumes the lines overlaps the reads and the file is never in memory
+ * whole: only two chunks, and a copy of a line that straddles them. A file that fits
+ * in the first chunk is read without a thread. Lines are split like std::getline.
+ */
+class chunked_line_reader {
+public:
+    static constexpr size_t default_chunk_size = 1 << 20;
 
-    execution += std::to_string(current_time) + ", " + std::to_string(1) + ", load address " + vectors.at(intr_num) + " into the PC\n";
-    current_time++;
+    explicit chunked_line_reader(const std::string& filename, size_t chunk_size = default_chunk_size):
+        input_file(filename, std::ios::binary), opened(input_file.is_open()), chunk_size(chunk_size) {
+        if(!opened) {
+            return;
+        }
 
-    return std::make_pair(execution, current_time);
-}
+        current.resize(chunk_size);
+        input_file.read(current.data(), chunk_size);
+        current.resize(input_file.gcount());
+        if(current.size() == chunk_size) {
+            prefetch = std::thread([this] { read_ahead(); });
+        } else {
+            done = true;
+        }
+    }
 
-//Writes a string to a file
-void write_output(std::string execution, const char* filename) {
-    std::ofstream output_file(filename);
+    chunked_line_reader(const chunked_line_reader&) = delete;
+    chunked_line_reader& operator=(const chunked_line_reader&) = delete;
 
-    if (output_file.is_open()) {
-        output_file << execution;
-        output_file.close();  // Close the file when done
-        std::cout << "File content overwritten successfully." << std::endl;
-    } else {
-        std::cerr << "Error opening file!" << std::endl;
+    ~chunked_line_reader() {
+        if(prefetch.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopped = true;
+            }
+            changed.notify_all();
+            prefetch.join();
+        }
     }
 
-    std::cout << "Output generated in execution.txt" << std::endl;
-}
+    bool is_open() const {
+        return opened;
+    }
 
-//Helper function for a sanity check. Prints the external files table
-void print_external_files(std::vector<external_file> files) {
-    const int tableWidth = 24;
-
-    std::cout << "List of external files (" << files.size() << " entry(s)): " << std::endl;
-    
-    // Print top border
-    std::cout << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
-    
-    // Print headers
-    std::cout << "|"
-              << std::setfill(' ') << std::setw(10) << "file name"
-              << std::setw(2) << "|"
-              << std::setfill(' ') << std::setw(10) << "files size"
-              << std::setw(2) << "|" << std::endl;
-    
-    // Print separator
-    std::cout << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
-    
-    // Print each PCB entry
-    for (const auto& file : files) {
-        std::cout << "|"
-                  << std::setfill(' ') << std::setw(10) << file.program_name
-                  << std::setw(2) << "|"
-                  << std::setw(10) << file.size
-                  << std::setw(2) << "|" << std::endl;
-    }
-    
-    // Print bottom border
-    std::cout << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
-}
+    //The next line, without its '\n'; valid until the next call. False at the end of the file.
+    bool next(std::string_view& line) {
+        carry.clear();
+        bool partial = false;
+        while(true) {
+            const char* begin = current.data() + position;
+            const char* end = current.data() + current.size();
+            const char* newline = std::find(begin, end, '\n');
+            if(newline != end) {
+                position += newline - begin + 1;
+                if(!partial) {
+                    line = std::string_view(begin, newline - begin);
+                } else {
+                    carry.append(begin, newline);
+                    line = carry;
+                }
+                return true;
+            }
 
-//This function takes as input: the current PCB and the waitqueue (which is a
-//std::vector of the PCB struct); the function returns the information as a table
-std::string print_PCB(PCB current, std::vector<PCB> _PCB) {
-    const int tableWidth = 55;
-
-    std::stringstream buffer;
-    
-    // Print top border
-    buffer << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
-    
-    // Print headers
-    buffer << "|"
-              << std::setfill(' ') << std::setw(4) << "PID"
-              << std::setw(2) << "|"
-              << std::setfill(' ') << std::setw(12) << "program name"
-              << std::setw(2) << "|"
-              << std::setfill(' ') << std::setw(16) << "partition number"
-              << std::setw(2) << "|"
-              << std::setfill(' ') << std::setw(5) << "size"
-              << std::setw(2) << "|" 
-              << std::setfill(' ') << std::setw(8) << "state"
-              << std::setw(2) << "|" << std::endl;
-    
-    // Print separator
-    buffer << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
-
-    buffer << "|"
-                  << std::setfill(' ') << std::setw(4) << current.PID
-                  << std::setw(2) << "|"
-                  << std::setw(12) << current.program_name
-                  << std::setw(2) << "|"
-                  << std::setw(16) << current.partition_number
-                  << std::setw(2) << "|"
-                  << std::setw(5) << current.size
-                  << std::setw(2) << "|"
-                  << std::setw(8) << "running"
-                  << std::setw(2) << "|" << std::endl;
-    
-    // Print each PCB entry
-    for (const auto& program : _PCB) {
-        buffer << "|"
-                  << std::setfill(' ') << std::setw(4) << program.PID
-                  << std::setw(2) << "|"
-                  << std::setw(12) << program.program_name
-                  << std::setw(2) << "|"
-                  << std::setw(16) << program.partition_number
-                  << std::setw(2) << "|"
-                  << std::setw(5) << program.size
-                  << std::setw(2) << "|"
-                  << std::setw(8) << "waiting"
-                  << std::setw(2) << "|" << std::endl;
-    }
-    
-    // Print bottom border
-    buffer << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
-
-    return buffer.str();
-}
+            //the line goes on in the next chunk, if there is one
+            carry.append(begin, end);
+            partial = partial || begin != end;
+            if(!next_chunk()) {
+                line = carry;
+                return partial;
+            }
+        }
+    }
 
+private:
+    //Runs on the prefetch thread: keeps one chunk ready ahead of the one being read
+    void read_ahead() {
+        std::vector<char> chunk;
+        while(true) {
+            chunk.resize(chunk_size);
+            input_file.read(chunk.data(), chunk_size);
+            chunk.resize(input_file.gcount());
+            const bool last = chunk.size() < chunk_size;
 
-// Searches the external_files table and returns the size of the program
-unsigned int get_size(std::string name, std::vector<external_file> external_files) {
-    int size = -1;
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return !ready || stopped; });
+            if(stopped) {
+                return;
+            }
+            std::swap(chunk, ahead);
+            ready = true;
+            done = last;
+            changed.notify_all();
+            if(last) {
+                return;
+            }
+        }
+    }
 
-    for (auto file : external_files) { 
-        if(file.program_name == name){
-            size = file.size;
-            break;
+    //Moves on to the chunk read ahead; false if the file has no more
+    bool next_chunk() {
+        position = 0;
+        if(!prefetch.joinable()) {
+            current.clear();
+            return false;
         }
+
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] { return ready; });
+        std::swap(current, ahead);
+        ready = false;
+        const bool more = !current.empty() || !done;
+        if(done) {
+            guard.unlock();
+            prefetch.join();
+        } else {
+            changed.notify_all();
+        }
+        return more;
     }
 
-    return size;
-}
+    std::ifstream           input_file;         //!< read by the prefetch thread once it runs
+    bool                    opened;
+    size_t                  chunk_size;
+    std::vector<char>       current;            //!< the chunk lines are handed out from
+    size_t                  position = 0;
+    std::string             carry;              //!< a line started in an earlier chunk
 
-/*
-* Function to simulate CPU time 
-*/
+    std::thread             prefetch;
+    std::mutex              lock;
+    std::condition_variable changed;
+    std::vector<char>       ahead;              //!< the chunk read ahead, once 'ready'
+    bool                    ready = false;
+    bool                    done = false;       //!< 'ahead' is the last chunk
+    bool                    stopped = false;
+};
 
-std::string simulate_cpu(int duration, int& current_time) {
+/**
+ * \brief a trace compiled once so simulate_trace never has to touch the text again
+ *
+ * All blocks share one array of instructions. Block 0 is the trace itself, every
+ * other block is the trace of a FORK child. The tables are either owned by the trace
+ * (when it was compiled from text) or live in a mapped binary trace file.
+ */
+class compiled_trace {
+public:
+    compiled_trace() = default;
+    compiled_trace(compiled_trace&&) = default;
+    compiled_trace& operator=(compiled_trace&&) = default;
 
-    std::string result = std::to_string(current_time) + ", " 
-                        + std::to_string(duration) + ", "
-                        + "CPU Burst\n";
-    current_time += duration;
-    return result;
+    //A trace that owns its tables
+    compiled_trace(std::vector<trace_instr> code, std::vector<block_range> blocks,
+                   std::vector<fork_target> forks, std::vector<std::string> programs):
+        owned_code(std::move(code)), owned_blocks(std::move(blocks)), owned_forks(std::move(forks)),
+        programs(std::move(programs)) {
+        code_table = {owned_code.data(), owned_code.size()};
+        block_table = owned_blocks.data();
+        blocks_size = owned_blocks.size();
+        fork_table = owned_forks.data();
+        forks_size = owned_forks.size();
+    }
 
-}
+    //A trace whose tables are inside 'file'; the pointers have to point into it
+    compiled_trace(mapped_file file, instr_span code, const block_range* blocks, size_t block_count,
+                   const fork_target* forks, size_t fork_count, std::vector<std::string> programs):
+        mapping(std::move(file)), programs(std::move(programs)), code_table(code),
+        block_table(blocks), blocks_size(block_count), fork_table(forks), forks_size(fork_count) {}
 
-/*
-    ISR execution function, simulates the execution of an ISR for a given device
-    device_num: the device number (index in the delays vector)
-    current_time: reference to the current time in the simulation
-    delays: vector of delays for each device
+    instr_span block(int id) const {
+        const block_range& range = block_table[id];
+        return {code_table.first + range.offset, (size_t)range.count};
+    }
 
-    returns a string representing the ISR execution log
-*/
+    const block_range& range(int id) const { return block_table[id]; }
+    const fork_target& fork(int id) const { return fork_table[id]; }
+    const std::string& program(int id) const { return programs[id]; }
 
-std::string execute_isr(int device_num, int& current_time, std::vector<int>& delays,
-                        const std::string& isr_type) {
-    int isr_delay = delays[device_num];
-    std::string result = std::to_string(current_time) + ", " 
-                        + std::to_string(isr_delay) + ", " 
-                        + isr_type + ": run the ISR\n";
-    current_time += isr_delay;
-    return result;
+    //Symbol id of an EXEC's program; the trace has to be bound first
+    int symbol(int id) const { return symbol_ids[id]; }
 
-}
+    //Resolves the program names of the trace to symbols, adding the ones 'symbols' does
+    //not have yet. Traces are bound when they load, before any simulation runs them.
+    void bind(symbol_table& symbols) {
+        symbol_ids.clear();
+        for(const auto& name : programs) {
+            symbol_ids.push_back(symbols.intern(name));
+        }
+    }
 
-/*
-    IRET execution function, simulates the execution of the IRET instruction
-    current_time: reference to the current time in the simulation
+    instr_span code() const { return code_table; }
+    size_t block_count() const { return blocks_size; }
+    size_t fork_count() const { return forks_size; }
+    size_t program_count() const { return programs.size(); }
 
-    returns a string representing the IRET execution log
-*/
-std::string execute_iret(int& current_time) {
-    std::string result = std::to_string(current_time) + ", 1, IRET\n";
-    current_time += 1;
-    return result;
-}
+private:
+    std::vector<trace_instr>    owned_code;
+    std::vector<block_range>    owned_blocks;
+    std::vector<fork_target>    owned_forks;
+    mapped_file                 mapping;
+    std::vector<std::string>    programs;       //!< interned program names
+    std::vector<int>            symbol_ids;     //!< symbol of each program, once bound
 
-/*
-    restore_context function, simulates the restoration of the CPU context
-    current_time: reference to the current time in the simulation
-
-    returns a string representing the context restoration log
-*/
-std::string restore_context(int& current_time) {
-    const int CONTEXT_TIME = 10;
-    std::string result = std::to_string(current_time) + ", " 
-                        + std::to_string(CONTEXT_TIME) + ", " 
-                        + "context restored\n";
-    current_time += CONTEXT_TIME;
-    return result;
-}
+    instr_span                  code_table{nullptr, 0};
+    const block_range*          block_table = nullptr;
+    size_t                      blocks_size = 0;
+    const fork_target*          fork_table = nullptr;
+    size_t                      forks_size = 0;
+};
 
-/*
-    switch_to_user_mode function, simulates switching the CPU back to user mode
-    current_time: reference to the current time in the simulation
+//Turns a single trace line into an instruction, interning the EXEC program name
+trace_instr compile_line(std::string_view line, unsigned int index, std::vector<std::string>& programs,
+                         std::unordered_map<std::string, int>& program_ids);
 
-    returns a string representing the switch to user mode log
-*/
-std::string switch_to_user_mode(int& current_time) {
-    std::string result = std::to_string(current_time) + ", 1, switch to user mode\n";
-    current_time += 1;
-    return result;
-}
+/**
+ * \brief collect the child's trace of a FORK
+ *
+ * Walks the block from the FORK onwards and keeps what the child runs: everything
+ * after IF_CHILD (and after ENDIF) up to IF_PARENT, with an EXEC ending the child.
+ * 
+ * @param block the block holding the FORK
+ * @param fork_index index of the FORK within the block
+ * @param parent_index set to the index the parent is supposed to resume from
+ * @return the child's instructions
+ * 
+ */
+std::vector<trace_instr> split_fork_child(instr_span block, size_t fork_index, int& parent_index);
 
+/**
+ * \brief compiles a trace fed to it one line at a time
+ *
+ * Lines are parsed as they come in, so the text never has to be held whole; once
+ * they are all in, finish() resolves every FORK to its child block and parent resume
+ * index. Children with the same source lines share one block.
+ */
+class trace_compiler {
+public:
+    void add_line(std::string_view line) {
+        root.push_back(compile_line(line, root.size(), programs, program_ids));
+    }
 
-/*
-    handle_interrupt function, simulates the entire interrupt handling process
-    device_num: the device number (index in the vectors and delays vectors)
-    current_time: reference to the current time in the simulation
-    vectors: vector of ISR addresses for each device
-    delays: vector of delays for each device
-    interrupt_type: string representing the type of interrupt (e.g., "SYSCALL", "END_IO")
+    void reserve(size_t lines) {
+        root.reserve(lines);
+    }
 
-    returns a string representing the complete interrupt handling log
-*/
-std::string handle_interrupt(int device_num, int& current_time, std::vector<std::string>& vectors, std::vector<int>& delays, const std::string& interrupt_type) {
+    //The compiled trace of the lines added so far; the compiler is left empty
+    compiled_trace finish() {
+        std::vector<trace_instr> code;
+        std::vector<block_range> blocks;
+        std::vector<fork_target> forks;
 
-    std::string result = "";
-    const int CONTEXT_TIME = 10;
+        //blocks are keyed by their source lines so identical children are compiled once
+        std::map<std::vector<unsigned int>, int> block_ids;
+        std::vector<int> pending;
 
-    auto [boilerplate, new_time] = intr_boilerplate(current_time, device_num, CONTEXT_TIME, vectors);
+        auto block_key = [](const std::vector<trace_instr>& block) {
+            std::vector<unsigned int> key;
+            key.reserve(block.size());
+            for(const auto& instr : block) {
+                key.push_back(instr.line);
+            }
+            return key;
+        };
 
-    result += boilerplate;
-    current_time = new_time;
+        auto intern_block = [&](const std::vector<trace_instr>& block) {
+            auto [it, inserted] = block_ids.try_emplace(block_key(block), (int)blocks.size());
+            if(inserted) {
+                blocks.push_back({code.size(), block.size()});
+                code.insert(code.end(), block.begin(), block.end());
+                pending.push_back(it->second);
+            }
+            return it->second;
+        };
 
-    result += execute_isr(device_num, current_time, delays, interrupt_type);
-    result += execute_iret(current_time);
-    result += restore_context(current_time);
-    result += switch_to_user_mode(current_time);
+        //the trace itself is block 0; it is moved in, as it is by far the largest
+        block_ids.emplace(block_key(root), 0);
+        blocks.push_back({0, root.size()});
+        code = std::move(root);
+        pending.push_back(0);
 
-    return result;
+        while(!pending.empty()) {
+            int id = pending.back();
+            pending.pop_back();
+            block_range range = blocks[id];
+
+            for(size_t i = 0; i < range.count; i++) {
+                if(code[range.offset + i].op != trace_op::FORK) {
+                    continue;
+                }
+
+                fork_target target;
+                auto child = split_fork_child({code.data() + range.offset, (size_t)range.count}, i, target.parent_index);
+                target.child_block = intern_block(child);
+
+                code[range.offset + i].arg = (int)forks.size();
+                forks.push_back(target);
+            }
+        }
+
+        root.clear();
+        program_ids.clear();
+        return compiled_trace(std::move(code), std::move(blocks), std::move(forks), std::move(programs));
+    }
+
+private:
+    std::vector<trace_instr>                root;
+    std::vector<std::string>                programs;
+    std::unordered_map<std::string, int>    program_ids;
+};
+
+/**
+ * \brief compile a trace
+ *
+ * @param lines the lines of the trace file
+ * @return the compiled trace
+ * 
+ */
+compiled_trace compile_trace(const std::vector<std::string>& lines);
+
+/**
+ * \brief compile a trace, failing on the first malformed line
+ *
+ * For the library (see simulator): nothing is printed, and a line without a
+ * "activity, number" shape is an error instead of a NOP.
+ *
+ * @param lines the lines of the trace
+ * @param trace the compiled trace, if it compiles
+ * @param error what is wrong, if it does not
+ * @return false if a line is malformed
+ *
+ */
+bool compile_trace(const std::vector<std::string>& lines, compiled_trace& trace, std::string& error);
+
+//Header of a binary trace file. The sections follow it in this order, each starting
+//on an 8 byte boundary: instructions, block table, fork table, string offsets (one
+//more than there are strings) and string bytes.
+struct binary_trace_header {
+    char            magic[8];       //!< BINARY_TRACE_MAGIC
+    std::uint32_t   byte_order;     //!< 0x01020304 as stored by the machine that wrote it
+    std::uint32_t   instr_size;     //!< sizeof(trace_instr), to catch layout mismatches
+    std::uint64_t   instr_count;
+    std::uint64_t   block_count;
+    std::uint64_t   fork_count;
+    std::uint64_t   string_count;
+    std::uint64_t   string_bytes;
+};
+
+const char BINARY_TRACE_MAGIC[8] = {'I', 'T', 'R', 'A', 'C', 'E', '\0', '1'};
+
+//Offsets of the sections of a binary trace, as laid out by write_binary_trace
+struct binary_trace_layout {
+    std::uint64_t instrs, blocks, forks, string_offsets, strings, end;
+
+    explicit binary_trace_layout(const binary_trace_header& header) {
+        auto align = [](std::uint64_t offset) { return (offset + 7) & ~std::uint64_t(7); };
+        instrs          = align(sizeof(binary_trace_header));
+        blocks          = align(instrs + header.instr_count * sizeof(trace_instr));
+        forks           = align(blocks + header.block_count * sizeof(block_range));
+        string_offsets  = align(forks + header.fork_count * sizeof(fork_target));
+        strings         = string_offsets + (header.string_count + 1) * sizeof(std::uint64_t);
+        end             = strings + header.string_bytes;
+    }
+};
+
+/**
+ * \brief write a compiled trace in the binary trace format
+ *
+ * The records are the in-memory layout of the tables, so a binary trace can be
+ * mapped and run without parsing or copying.
+ * 
+ * @param trace the trace to write
+ * @param filename the binary trace file
+ * @return false if the file could not be written
+ * 
+ */
+bool write_binary_trace(const compiled_trace& trace, const std::string& filename);
+
+//True if the file starts like a binary trace
+bool is_binary_trace(const std::string& filename);
+
+/**
+ * \brief map a binary trace and run on it in place
+ *
+ * Only the program names are copied out of the file. Everything the simulation
+ * indexes with is checked first, so a corrupt file is reported instead of read out
+ * of bounds.
+ * 
+ * @param filename the binary trace file
+ * @param trace the trace, backed by the mapping, if the file is valid
+ * @param error what is wrong with the file, if it is not
+ * @return false if the file cannot be read or is not a valid binary trace
+ * 
+ */
+bool read_binary_trace(const std::string& filename, compiled_trace& trace, std::string& error);
+
+//read_binary_trace for the command line tools: a bad file is reported and the program exits
+compiled_trace load_binary_trace(const std::string& filename);
+
+//The vectors the FORK and EXEC system calls go through
+const int FORK_VECTOR = 2;
+const int EXEC_VECTOR = 3;
+
+/**
+ * \brief check that every interrupt of a trace has a vector and an ISR delay
+ *
+ * For the library (see simulator), as the engines index the tables with the device
+ * numbers of SYSCALL and END_IO, and FORK and EXEC with FORK_VECTOR and EXEC_VECTOR.
+ *
+ * @param trace a compiled trace
+ * @param vectors the vector table
+ * @param delays the device table
+ * @param error the first line that raises an interrupt the tables do not have, if any
+ * @return false if there is such a line
+ *
+ */
+bool check_devices(const compiled_trace& trace, const std::vector<std::string>& vectors,
+                   const std::vector<int>& delays, std::string& error);
+
+//Reads a trace file and compiles it; a file that cannot be opened gives an empty trace.
+//The text is streamed through the compiler a chunk at a time (see chunked_line_reader).
+//Binary traces (see write_binary_trace) are mapped instead.
+compiled_trace load_trace(const std::string& filename);
+
+//An external program the way EXEC needs it: its size and its compiled trace, which is
+//only loaded once something execs it (see program_registry::trace)
+struct program_image {
+    unsigned int                            size;
+    std::string                             filename;   //!< where the trace is loaded from
+    mutable std::unique_ptr<compiled_trace> trace;      //!< null until it is loaded
+};
+
+/**
+ * \brief the external programs, indexed by symbol
+ *
+ * Building the registry only records the programs of the external files table; the
+ * trace of a program is read, compiled and bound the first time it is exec'd, and
+ * every later EXEC of it is served from here. Loading binds the trace, which can add
+ * names to the symbol table, so runners that simulate in parallel load every program
+ * with load_all() before the first simulation starts.
+ */
+class program_registry {
+public:
+    program_registry() = default;
+
+    program_registry(const std::vector<external_file>& files, symbol_table& symbols): symbols(&symbols) {
+        images.reserve(files.size());
+        for (const auto& file : files) {
+            //like the table itself, the first entry of a name wins
+            int symbol = symbols.intern(file.program_name);
+            if(find(symbol) == nullptr) {
+                insert(symbol, {file.size, file.program_name + ".txt", nullptr});
+            }
+        }
+    }
+
+    //Adds a program that is already compiled and bound; returns false if the symbol is taken
+    bool add(int symbol, unsigned int size, compiled_trace trace) {
+        if(find(symbol) != nullptr) {
+            return false;
+        }
+        insert(symbol, {size, "", std::make_unique<compiled_trace>(std::move(trace))});
+        return true;
+    }
+
+    //Returns the program, or nullptr if it is not in the external files table
+    const program_image* find(int symbol) const {
+        if(symbol < 0 || (size_t)symbol >= by_symbol.size() || by_symbol[symbol] == -1) {
+            return nullptr;
+        }
+        return &images[by_symbol[symbol]];
+    }
+
+    //The trace of a program of this registry, loading it if it is the first EXEC of it
+    const compiled_trace& trace(const program_image& image) const {
+        if(!image.trace) {
+            PROFILE_SCOPE(PROGRAM_LOAD);
+            image.trace = std::make_unique<compiled_trace>(load_trace(image.filename));
+            image.trace->bind(*symbols);
+        }
+        return *image.trace;
+    }
+
+    //Loads every program no EXEC has loaded yet
+    void load_all() const {
+        for(const auto& image : images) {
+            trace(image);
+        }
+    }
+
+private:
+    void insert(int symbol, program_image image) {
+        if((size_t)symbol >= by_symbol.size()) {
+            by_symbol.resize(symbol + 1, -1);
+        }
+        by_symbol[symbol] = images.size();
+        images.push_back(std::move(image));
+    }
+
+    std::vector<program_image>  images;
+    std::vector<int>            by_symbol;  //!< index into images of each symbol, -1 for none
+    symbol_table*               symbols = nullptr;  //!< where loaded traces are bound
+};
+
+//The tables a simulation reads but never changes. They are owned by a table_cache and
+//shared by reference through the whole simulation (and between simulations).
+struct simulation_context {
+    const std::vector<std::string>&         vectors;        //!< ISR address of each device
+    const std::vector<int>&                 delays;         //!< ISR delay of each device
+    const std::vector<external_file>&       external_files; //!< programs that can be exec'd
+    const program_registry&                 programs;       //!< the external files, compiled as they are exec'd
+    const std::vector<memory_partition_t>&  partitions;     //!< the partition table
+    const symbol_table&                     symbols;        //!< names of the programs
+};
+
+//A process on the simulation stack: what it runs, how far it got, and what has to be
+//released once it finishes
+struct process_frame {
+    const compiled_trace*   trace;
+    int                     block;
+    size_t                  pc;                 //!< index of the next instruction to run
+    int                     process;            //!< slot in the process table
+    int                     release_partition;  //!< freed when the process finishes, -1 for none
+    bool                    parent_waiting;     //!< the parent is on the wait queue until then
+    bool                    owns_process;       //!< removes the process from the table when it finishes
+    int                     recording = -1;     //!< what exec_memo records of it, -1 for nothing
+    int                     program = -1;       //!< symbol of the external program 'trace' is, -1 for the one simulated
+};
+
+//Opens a table file, exiting if it cannot be read
+void open_table(std::ifstream& input_file, const std::string& filename);
+
+//Reads a vector table: one ISR address per line, indexed by device number
+std::vector<std::string> load_vector_table(const std::string& filename);
+
+//Reads a device table: one ISR delay per line, indexed by device number
+std::vector<int> load_device_table(const std::string& filename);
+
+//Reads the external files table: one "program name,size" entry per line
+std::vector<external_file> load_external_files(const std::string& filename);
+
+//Reads a partition table: one partition size per line, numbered from 1
+std::vector<memory_partition_t> load_partition_table(const std::string& filename);
+
+/**
+ * \brief the tables and traces read from disk, each file parsed once
+ *
+ * Every simulation gets its context from here, so runs naming the same files
+ * share one copy of each table. Entries are never removed, so the references
+ * handed out stay valid for the lifetime of the cache.
+ */
+class table_cache {
+public:
+    const std::vector<std::string>& vector_table(const std::string& filename) {
+        auto it = vector_tables.find(filename);
+        if(it == vector_tables.end()) {
+            it = vector_tables.emplace(filename, load_vector_table(filename)).first;
+        }
+        return it->second;
+    }
+
+    const std::vector<int>& device_table(const std::string& filename) {
+        auto it = device_tables.find(filename);
+        if(it == device_tables.end()) {
+            it = device_tables.emplace(filename, load_device_table(filename)).first;
+        }
+        return it->second;
+    }
+
+    //An empty filename gives the default partition table
+    const std::vector<memory_partition_t>& partition_table(const std::string& filename) {
+        auto it = partition_tables.find(filename);
+        if(it == partition_tables.end()) {
+            it = partition_tables.emplace(filename, filename.empty() ? default_partitions()
+                                                                     : load_partition_table(filename)).first;
+        }
+        return it->second;
+    }
+
+    const compiled_trace& trace(const std::string& filename) {
+        auto it = traces.find(filename);
+        if(it == traces.end()) {
+            it = traces.emplace(filename, load_trace(filename)).first;
+            it->second.bind(symbols);
+        }
+        return it->second;
+    }
+
+    //The context of a simulation using the given tables
+    simulation_context context(const std::string& vector_file, const std::string& device_file,
+                               const std::string& external_files_file, const std::string& partition_file) {
+        const auto& vectors = vector_table(vector_file);
+        const auto& delays = device_table(device_file);
+
+        auto it = external_tables.find(external_files_file);
+        if(it == external_tables.end()) {
+            auto files = load_external_files(external_files_file);
+            program_registry programs(files, symbols);
+            it = external_tables.emplace(external_files_file,
+                                         external_table{std::move(files), std::move(programs)}).first;
+        }
+
+        return {vectors, delays, it->second.files, it->second.programs, partition_table(partition_file), symbols};
+    }
+
+    //Loads every external program of every context handed out so far, so simulations
+    //of them only read the cache from then on (see program_registry)
+    void load_programs() {
+        for(const auto& [filename, table] : external_tables) {
+            table.programs.load_all();
+        }
+    }
+
+private:
+    //An external files table and the programs it lists
+    struct external_table {
+        std::vector<external_file>  files;
+        program_registry            programs;
+    };
+
+    std::map<std::string, std::vector<std::string>>         vector_tables;
+    std::map<std::string, std::vector<int>>                 device_tables;
+    std::map<std::string, external_table>                   external_tables;
+    std::map<std::string, std::vector<memory_partition_t>>  partition_tables;
+    std::map<std::string, compiled_trace>                   traces;
+    symbol_table                                            symbols;    //!< shared by everything loaded
+};
+
+/**
+ * \brief parse the CLI arguments
+ *
+ * This helper function parses command line arguments and checks for errors 
+ * 
+ * @param argc number of command line arguments
+ * @param argv the command line arguments
+ * @param tables where the tables named on the command line are loaded
+ * @return the simulation context: the parsed vector table, the delays, the external files
+ *         and the partition table
+ * 
+ */
+simulation_context parse_args(int argc, char** argv, table_cache& tables);
+
+//One simulation of a batch: the files it reads and the prefix of the files it writes
+struct batch_job {
+    std::string trace_file;
+    std::string vector_file;
+    std::string device_file;
+    std::string external_files_file;
+    std::string output_prefix;      //!< writes <prefix>execution.txt and <prefix>system_status.txt
+    std::string partition_file;     //!< empty for the default partition table
+};
+
+/**
+ * \brief runs independent tasks on a pool of threads
+ *
+ * Every worker owns a deque of task indices, dealt out round robin. A worker takes
+ * tasks from the front of its own deque and, once that is empty, steals from the
+ * back of the others', so a few long tasks do not leave the other cores idle.
+ */
+class work_stealing_executor {
+public:
+    //0 threads means one per hardware thread
+    explicit work_stealing_executor(unsigned int threads):
+        threads(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    //Runs task(i) for every i in [0, count) and returns once all of them are done
+    void run(size_t count, const std::function<void(size_t)>& task) {
+        size_t workers = std::min<size_t>(threads, std::max<size_t>(count, 1));
+        std::vector<task_queue> queues(workers);
+        for (size_t i = 0; i < count; i++) {
+            queues[i % workers].tasks.push_back(i);
+        }
+
+        std::vector<std::thread> pool;
+        for (size_t w = 1; w < workers; w++) {
+            pool.emplace_back([&, w] { work(w, queues, task); });
+        }
+        work(0, queues, task);
+
+        for (auto& worker : pool) {
+            worker.join();
+        }
+    }
+
+    unsigned int size() const {
+        return threads;
+    }
+
+private:
+    struct task_queue {
+        std::mutex          lock;
+        std::deque<size_t>  tasks;
+    };
+
+    static void work(size_t self, std::vector<task_queue>& queues, const std::function<void(size_t)>& task) {
+        size_t next;
+        while(take(queues[self], true, next) || steal(self, queues, next)) {
+            task(next);
+        }
+    }
+
+    static bool take(task_queue& queue, bool front, size_t& next) {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if(queue.tasks.empty()) {
+            return false;
+        }
+        if(front) {
+            next = queue.tasks.front();
+            queue.tasks.pop_front();
+        } else {
+            next = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        return true;
+    }
+
+    //Tasks are never added once run() started, so no work left anywhere means done
+    static bool steal(size_t self, std::vector<task_queue>& queues, size_t& next) {
+        for (size_t i = 1; i < queues.size(); i++) {
+            if(take(queues[(self + i) % queues.size()], false, next)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned int threads;
+};
+
+//Strips leading and trailing blanks from a manifest field
+std::string_view trim(std::string_view text);
+
+/**
+ * \brief read a batch manifest
+ *
+ * One job per line: trace,vector table,device table,external files,output prefix
+ * with an optional partition table as sixth field. Blank lines and lines starting
+ * with '#' are skipped.
+ * 
+ * @param filename the manifest
+ * @return the jobs, in manifest order
+ * 
+ */
+std::vector<batch_job> load_manifest(const std::string& filename);
+
+//What a parameter sweep varies; every configuration is one value of each list. An
+//empty list keeps the value of the simulation the sweep starts from.
+struct sweep_spec {
+    std::vector<std::string>    device_tables;
+    std::vector<int>            delay_scales;       //!< percent of every device delay
+    std::vector<int>            context_saves;      //!< time to save the context
+    std::vector<std::string>    partition_tables;
+};
+
+//Parses a comma separated list of numbers and lo..hi or lo..hi:step ranges into 'values'
+bool parse_sweep_values(std::string_view text, std::vector<int>& values);
+
+/**
+ * \brief loads a parameter sweep
+ *
+ * One parameter per line, as "name: values", values separated by commas; blank lines
+ * and lines starting with '#' are skipped. device_table and partition_table take file
+ * names ("default" for the default partition table), delay_scale (percent) and
+ * context_save numbers or lo..hi[:step] ranges.
+ * 
+ * @param filename the sweep file
+ * @return what to sweep
+ * 
+ */
+sweep_spec load_sweep(const std::string& filename);
+
+//Name of a trace activity as it appears in the trace file
+std::string_view trace_op_name(trace_op op);
+
+//The inverse of trace_op_name; false for names it does not produce
+bool trace_op_from_name(std::string_view name, trace_op& op);
+
+//The slots of the waiting processes of a system status table: 'head' (if it is not -1)
+//and then 'queue'. A FORK shows its parent ahead of the wait queue this way.
+struct waiting_view {
+    int                         head;
+    const std::vector<int>&     queue;
+
+    struct iterator {
+        const waiting_view*     view;
+        size_t                  index;
+
+        int operator*() const { return (*view)[index]; }
+        iterator& operator++() { index++; return *this; }
+        bool operator!=(const iterator& other) const { return index != other.index; }
+    };
+
+    size_t size() const { return (head != -1 ? 1 : 0) + queue.size(); }
+    int operator[](size_t i) const { return head != -1 ? (i == 0 ? head : queue[i - 1]) : queue[i]; }
+    iterator begin() const { return {this, 0}; }
+    iterator end() const { return {this, size()}; }
+};
+
+//Kinds of execution log lines. FIND_VECTOR and LOAD_ADDRESS take the interrupt number
+//as operand, PROGRAM_SIZE the size of the program; the *_ERROR lines have no duration.
+//The codes are stored in binary event logs, so new kinds go at the end.
+enum class event_kind : unsigned char {
+    CPU_BURST,
+    SWITCH_TO_KERNEL,
+    CONTEXT_SAVED,
+    FIND_VECTOR,
+    LOAD_ADDRESS,
+    SYSCALL_ISR,
+    ENDIO_ISR,
+    RUN_SYSCALL_ISR,
+    RUN_ENDIO_ISR,
+    IRET,
+    CONTEXT_RESTORED,
+    SWITCH_TO_USER,
+    CLONE_PCB,
+    SCHEDULER_CALLED,
+    PROGRAM_SIZE,
+    LOAD_PROGRAM,
+    MARK_PARTITION,
+    UPDATE_PCB,
+    FORK_PARTITION_ERROR,
+    EXEC_NOT_FOUND_ERROR,
+    EXEC_PARTITION_ERROR,
+    START_IO,           //!< operand: the device; only with overlapped I/O
+    CPU_IDLE,           //!< only with overlapped I/O or several cores
+    MEMORY_WAIT,        //!< a core waits for the partition table; only with several cores
+    END_IO_COALESCED    //!< operand: the kernel time it saves; only with END_IO coalescing
+};
+
+//The kind with the highest code, for readers checking what they are given
+constexpr event_kind last_event_kind = event_kind::END_IO_COALESCED;
+
+//Name of an event kind, as it is spelled above
+std::string_view event_kind_name(event_kind kind);
+
+//How long a process took: it arrived (was created) at 'arrival', first got the CPU at
+//'first_run' and spent 'wait' ready without running
+struct process_times {
+    int     arrival;
+    int     first_run;
+    int     wait;
+};
+
+/**
+ * \brief receiver of everything the simulation reports
+ *
+ * simulate_trace and the interrupt helpers emit each event as it happens instead of
+ * building strings, so the sink decides how (and whether) it is stored.
+ */
+class event_sink {
+public:
+    virtual ~event_sink() = default;
+
+    //One line of the execution log
+    virtual void execution(int time, int duration, event_kind kind, int operand = 0) = 0;
+
+    //One system status table, taken after a FORK or EXEC; 'running' and 'waiting' are
+    //slots of 'processes'
+    virtual void system_status(int time, trace_op trace, int duration, const process_table& processes,
+                               int running, waiting_view waiting) = 0;
+
+    //A partition was taken (occupied) or given back; not part of either log
+    virtual void partition_changed(int /*time*/, int /*partition_number*/, bool /*occupied*/) {}
+
+    //A process exited at 'time' (only simulate_scheduled tells); 'slot' is still in 'processes'
+    virtual void process_exited(int /*time*/, const process_table& /*processes*/, int /*slot*/,
+                                const process_times& /*times*/) {}
+
+    //The events that follow ran on 'core' (only simulate_multicore tells)
+    virtual void core_changed(int /*core*/) {}
+
+    //The debug line of an EXEC of 'program_name', only for sinks that want details. It
+    //goes to stderr (see print_exec_debug) unless the sink has somewhere else for it.
+    virtual void exec_debug_line(const std::string& program_name);
+
+    //False if the sink has no use for system_status, so the simulation can skip
+    //building the process tables (and the EXEC debug trace) altogether
+    virtual bool wants_details() const { return true; }
+};
+
+//Writes to a file through a fixed size buffer that is flushed every time it fills up,
+//so output is never held in memory as a whole. Opened with std::ios::app, what is put
+//goes after what the file already holds, and counts from its end.
+class buffered_writer {
+public:
+    explicit buffered_writer(const char* filename, std::size_t capacity = 1 << 16,
+                             std::ios::openmode mode = std::ios::out):
+        file(filename, mode), buffer(capacity), used(0), written(0) {
+        std::error_code error;
+        std::uintmax_t size = std::filesystem::file_size(filename, error);
+        if((mode & std::ios::app) && !error) {
+            written = size;
+        }
+    }
+
+    ~buffered_writer() {
+        flush();
+    }
+
+    bool is_open() const {
+        return file.is_open();
+    }
+
+    void put(std::string_view text) {
+        if(text.size() > buffer.size() - used) {
+            flush();
+            if(text.size() > buffer.size()) {
+                PROFILE_SCOPE(WRITE_OUTPUT);
+                PROFILE_COUNT(BYTES_EMITTED, text.size());
+                file.write(text.data(), text.size());
+                written += text.size();
+                return;
+            }
+        }
+        std::copy(text.begin(), text.end(), buffer.data() + used);
+        used += text.size();
+    }
+
+    //Formats the number straight into the buffer
+    void put_int(long long value) {
+        const std::size_t max_digits = 20;
+        if(buffer.size() - used < max_digits) {
+            flush();
+        }
+        auto [end, ec] = std::to_chars(buffer.data() + used, buffer.data() + buffer.size(), value);
+        used = end - buffer.data();
+    }
+
+    void flush() {
+        PROFILE_SCOPE(WRITE_OUTPUT);
+        PROFILE_COUNT(BYTES_EMITTED, used);
+        if(used > 0) {
+            file.write(buffer.data(), used);
+            written += used;
+            used = 0;
+        }
+        file.flush();
+    }
+
+    //Bytes put so far, flushed or not
+    std::size_t bytes_written() const {
+        return written + used;
+    }
+
+private:
+    std::ofstream       file;
+    std::vector<char>   buffer;
+    std::size_t         used;
+    std::size_t         written;
+};
+
+void put_pcb_row(buffered_writer& out, const process_table& processes, int slot, std::string_view state);
+
+//Writes one table of the system_status_*.txt format
+void put_status_table(buffered_writer& out, int time, trace_op trace, int duration,
+                      const process_table& processes, int running, waiting_view waiting);
+
+//Renders events in the execution_*.txt and system_status_*.txt formats
+class text_log_sink : public event_sink {
+public:
+    //With std::ios::app, both logs go on from where the files end (see run_checkpointed_simulation)
+    text_log_sink(const char* execution_file, const char* status_file, const std::vector<std::string>& vectors,
+                  std::ios::openmode mode = std::ios::out):
+        execution_out(execution_file, 1 << 16, mode), status_out(status_file, 1 << 16, mode), vectors(vectors) {
+        //the text of the interrupt lines only depends on the device, so it is formatted once
+        find_vector_text.reserve(vectors.size());
+        load_address_text.reserve(vectors.size());
+        for(size_t i = 0; i < vectors.size(); i++) {
+            find_vector_text.push_back(format_find_vector(i));
+            load_address_text.push_back("load address " + vectors[i] + " into the PC\n");
+        }
+    }
+
+    bool is_open() const {
+        return execution_out.is_open() && status_out.is_open();
+    }
+
+    void flush() {
+        execution_out.flush();
+        status_out.flush();
+    }
+
+    std::size_t bytes_written() const {
+        return execution_out.bytes_written() + status_out.bytes_written();
+    }
+
+    std::size_t execution_bytes() const {
+        return execution_out.bytes_written();
+    }
+
+    std::size_t status_bytes() const {
+        return status_out.bytes_written();
+    }
+
+    void execution(int time, int duration, event_kind kind, int operand) override {
+        PROFILE_SCOPE(FORMAT);
+        execution_out.put_int(time);
+        execution_out.put(", ");
+
+        switch(kind) {
+            case event_kind::FORK_PARTITION_ERROR:
+            case event_kind::EXEC_NOT_FOUND_ERROR:
+            case event_kind::EXEC_PARTITION_ERROR:
+                put_core();
+                break;
+            default:
+                break;
+        }
+
+        switch(kind) {
+            case event_kind::FORK_PARTITION_ERROR:
+                execution_out.put("FORK ERROR: No available partition\n");
+                return;
+            case event_kind::EXEC_NOT_FOUND_ERROR:
+                execution_out.put("EXEC ERROR: Program not found\n");
+                return;
+            case event_kind::EXEC_PARTITION_ERROR:
+                execution_out.put("EXEC ERROR: No available partition\n");
+                return;
+            default:
+                break;
+        }
+
+        execution_out.put_int(duration);
+        execution_out.put(", ");
+        put_core();
+
+        switch(kind) {
+            case event_kind::CPU_BURST:         execution_out.put("CPU Burst\n"); break;
+            case event_kind::SWITCH_TO_KERNEL:  execution_out.put("switch to kernel mode\n"); break;
+            case event_kind::CONTEXT_SAVED:     execution_out.put("context saved\n"); break;
+            case event_kind::FIND_VECTOR:
+                if(operand >= 0 && (size_t)operand < find_vector_text.size()) {
+                    execution_out.put(find_vector_text[operand]);
+                } else {
+                    execution_out.put(format_find_vector(operand));
+                }
+                break;
+            case event_kind::LOAD_ADDRESS:
+                vectors.at(operand); //a bad device number fails like it always has
+                execution_out.put(load_address_text[operand]);
+                break;
+            case event_kind::SYSCALL_ISR:       execution_out.put("SYSCALL ISR (ADD STEPS HERE)\n"); break;
+            case event_kind::ENDIO_ISR:         execution_out.put("ENDIO ISR(ADD STEPS HERE)\n"); break;
+            case event_kind::RUN_SYSCALL_ISR:   execution_out.put("SYSCALL: run the ISR\n"); break;
+            case event_kind::RUN_ENDIO_ISR:     execution_out.put("END_IO: run the ISR\n"); break;
+            case event_kind::IRET:              execution_out.put("IRET\n"); break;
+            case event_kind::CONTEXT_RESTORED:  execution_out.put("context restored\n"); break;
+            case event_kind::SWITCH_TO_USER:    execution_out.put("switch to user mode\n"); break;
+            case event_kind::CLONE_PCB:         execution_out.put("cloning the PCB\n"); break;
+            case event_kind::SCHEDULER_CALLED:  execution_out.put("scheduler called\n"); break;
+            case event_kind::PROGRAM_SIZE:
+                execution_out.put("Program is ");
+                execution_out.put_int(operand);
+                execution_out.put(" Mb large\n");
+                break;
+            case event_kind::LOAD_PROGRAM:      execution_out.put("loading program into memory\n"); break;
+            case event_kind::MARK_PARTITION:    execution_out.put("marking partition as occupied\n"); break;
+            case event_kind::UPDATE_PCB:        execution_out.put("updating PCB\n"); break;
+            case event_kind::START_IO:
+                execution_out.put("start I/O on device ");
+                execution_out.put_int(operand);
+                execution_out.put("\n");
+                break;
+            case event_kind::CPU_IDLE:          execution_out.put("CPU idle\n"); break;
+            case event_kind::MEMORY_WAIT:       execution_out.put("waiting for the partition table\n"); break;
+            case event_kind::END_IO_COALESCED:
+                execution_out.put("END_IO: coalesced into this interrupt, saving ");
+                execution_out.put_int(operand);
+                execution_out.put("\n");
+                break;
+            default:                            execution_out.put("\n"); break;
+        }
+    }
+
+    //Lines from here on start their text with "core N: "
+    void core_changed(int core) override {
+        this->core = core;
+    }
+
+    void system_status(int time, trace_op trace, int duration, const process_table& processes,
+                       int running, waiting_view waiting) override {
+        PROFILE_SCOPE(FORMAT);
+        bool full = !deltas || full_next || (keyframe_interval != 0 && tables % keyframe_interval == 0);
+        tables++;
+        full_next = false;
+
+        if(!deltas) {
+            put_status_table(status_out, time, trace, duration, processes, running, waiting);
+            return;
+        }
+
+        size_t kept = common_prefix(processes, waiting.queue);
+        if(full) {
+            put_status_table(status_out, time, trace, duration, processes, running, waiting);
+        } else {
+            put_status_delta(time, trace, duration, processes, running, waiting.head, waiting.queue, kept);
+        }
+
+        shown_queue.erase(shown_queue.begin() + kept, shown_queue.end());
+        for(size_t i = kept; i < waiting.queue.size(); i++) {
+            shown_queue.push_back(shown_pcb::of(processes, waiting.queue[i]));
+        }
+    }
+
+    //Writes every system status table after the first one as a delta against the one
+    //before it (see put_status_delta); 'interval' > 0 writes every interval-th table in
+    //full as well. materialize_status_deltas turns the result back into full tables.
+    void use_status_deltas(unsigned int interval) {
+        deltas = true;
+        keyframe_interval = interval;
+        full_next = true;
+    }
+
+    //Writes the next table in full, whatever the interval says
+    void full_status_next() {
+        full_next = true;
+    }
+
+private:
+    void put_core() {
+        if(core != -1) {
+            execution_out.put("core ");
+            execution_out.put_int(core);
+            execution_out.put(": ");
+        }
+    }
+
+    static std::string format_find_vector(int vector) {
+        char vector_address[16];
+        snprintf(vector_address, sizeof(vector_address), "0x%04X", (ADDR_BASE + (vector * VECTOR_SIZE)));
+        return "find vector " + std::to_string(vector) + " in memory position " + vector_address + "\n";
+    }
+
+    //What a table showed of a process
+    struct shown_pcb {
+        unsigned int    PID;
+        int             program;
+        int             partition_number;
+        unsigned int    size;
+
+        static shown_pcb of(const process_table& processes, int slot) {
+            return {processes.PID[slot], processes.program[slot], processes.partition_number[slot], processes.size[slot]};
+        }
+
+        bool operator==(const shown_pcb& other) const {
+            return PID == other.PID && program == other.program && partition_number == other.partition_number
+                   && size == other.size;
+        }
+    };
+
+    //Entries at the bottom of the wait queue that are the same as in the last table
+    size_t common_prefix(const process_table& processes, const std::vector<int>& queue) const {
+        size_t count = 0;
+        while(count < queue.size() && count < shown_queue.size()
+              && shown_pcb::of(processes, queue[count]) == shown_queue[count]) {
+            count++;
+        }
+        return count;
+    }
+
+    void put_delta_row(std::string_view tag, const process_table& processes, int slot) {
+        status_out.put(tag);
+        status_out.put_int(processes.PID[slot]);
+        status_out.put(", ");
+        status_out.put(processes.program_name(processes.program[slot]));
+        status_out.put(", ");
+        status_out.put_int(processes.partition_number[slot]);
+        status_out.put(", ");
+        status_out.put_int(processes.size[slot]);
+        status_out.put("\n");
+    }
+
+    //A delta table: the running process, the head of the waiting list (FORK's parent) if
+    //there is one, how many wait queue entries are kept from the table before and the
+    //ones pushed on top of them. A queue of n processes that grows by one costs one line.
+    void put_status_delta(int time, trace_op trace, int duration, const process_table& processes,
+                          int running, int head, const std::vector<int>& queue, size_t kept) {
+        status_out.put("time: ");
+        status_out.put_int(time);
+        status_out.put("; current trace: ");
+        status_out.put(trace_op_name(trace));
+        status_out.put(", ");
+        status_out.put_int(duration);
+        status_out.put("\n");
+
+        put_delta_row("running: ", processes, running);
+        if(head != -1) {
+            put_delta_row("waiting: ", processes, head);
+        }
+
+        status_out.put("keep: ");
+        status_out.put_int(kept);
+        status_out.put("\n");
+        for(size_t i = kept; i < queue.size(); i++) {
+            put_delta_row("queue: ", processes, queue[i]);
+        }
+        status_out.put("\n");
+    }
+
+    buffered_writer                     execution_out;
+    buffered_writer                     status_out;
+    const std::vector<std::string>&     vectors;
+    std::vector<std::string>            find_vector_text;   //!< FIND_VECTOR line of each device
+    std::vector<std::string>            load_address_text;  //!< LOAD_ADDRESS line of each device
+    int                                 core = -1;          //!< -1 until a core is reported
+
+    bool                                deltas = false;
+    bool                                full_next = false;
+    unsigned int                        keyframe_interval = 0;
+    std::size_t                         tables = 0;         //!< system status tables written
+    std::vector<shown_pcb>              shown_queue;        //!< wait queue of the last table
+};
+
+/**
+ * \brief expand a system status file written with deltas into full tables
+ *
+ * The result is the system status file the simulation would have written without
+ * deltas. Full tables in the input are copied as they are.
+ * 
+ * @param delta_file the system status file with deltas
+ * @param status_file where the full tables go
+ * @return false if the files could not be opened
+ * 
+ */
+bool materialize_status_deltas(const std::string& delta_file, const std::string& status_file);
+
+//First word of every record of a binary event log. A record is one to four 32 bit
+//words; what follows the first word depends on the type:
+//  EXECUTION           code = event_kind, small = duration; nothing follows
+//  EXECUTION_OPERAND   as EXECUTION, followed by the operand
+//  EXECUTION_FULL      code = event_kind; followed by time, duration and operand
+//  STATUS              code = trace_op; followed by time, duration and the number of
+//                      PCB rows that come next (the running process, then the waiting ones)
+//  PCB_ROW             small = program name id; followed by PID, partition number and size
+//  STRING              code = string_kind; followed by id and length, then the bytes
+//                      zero padded to a whole number of words
+//  CORE                small = the core the records that follow ran on; nothing follows
+//EXECUTION and EXECUTION_OPERAND leave out the time: it is the time of the previous
+//execution event plus its duration, which is when almost every event happens.
+struct log_record {
+    std::uint8_t    type;
+    std::uint8_t    code;
+    std::uint16_t   small;
+};
+
+enum class log_record_type : std::uint8_t { EXECUTION, EXECUTION_OPERAND, EXECUTION_FULL, STATUS, PCB_ROW, STRING, CORE };
+enum class string_kind : std::uint8_t { PROGRAM_NAME, VECTOR };
+
+//Header of a binary event log; the records follow it
+struct log_header {
+    char            magic[8];       //!< EVENT_LOG_MAGIC
+    std::uint32_t   byte_order;     //!< 0x01020304 as stored by the machine that wrote it
+    std::uint32_t   word_size;      //!< sizeof(log_record)
+};
+
+const char EVENT_LOG_MAGIC[8] = {'I', 'E', 'V', 'L', 'O', 'G', '\0', '2'};
+
+/**
+ * \brief records events as binary records instead of text
+ *
+ * Nothing is formatted while the simulation runs; render_binary_log turns the log
+ * into the execution and system status text afterwards, byte for byte what
+ * text_log_sink would have written. The vector table is stored at the start of the
+ * log and program names the first time a PCB with them is shown, so the log can be
+ * rendered without the input files. A log has room for 0x10000 program names; past
+ * that the sink stops recording, and error() says why.
+ */
+class binary_log_sink : public event_sink {
+public:
+    binary_log_sink(const char* log_file, const std::vector<std::string>& vectors):
+        out(log_file, 1 << 16, std::ios::out | std::ios::binary), vectors(vectors) {
+        log_header header{};
+        std::copy(EVENT_LOG_MAGIC, EVENT_LOG_MAGIC + 8, header.magic);
+        header.byte_order = 0x01020304;
+        header.word_size = sizeof(log_record);
+        out.put(std::string_view((const char*)&header, sizeof(header)));
+
+        for(size_t i = 0; i < vectors.size(); i++) {
+            put_string(string_kind::VECTOR, i, vectors[i]);
+        }
+    }
+
+    bool is_open() const {
+        return out.is_open();
+    }
+
+    void flush() {
+        out.flush();
+    }
+
+    std::size_t bytes_written() const {
+        return out.bytes_written();
+    }
+
+    //Why the log is incomplete, empty if it has every event
+    const std::string& error() const {
+        return failure;
+    }
+
+    void execution(int time, int duration, event_kind kind, int operand) override {
+        PROFILE_SCOPE(FORMAT);
+        if(!failure.empty()) {
+            return;
+        }
+        if(kind == event_kind::LOAD_ADDRESS) {
+            vectors.at(operand); //same failure as the text log on a bad device number
+        }
+
+        if(time != next_time || duration < 0 || duration > 0xFFFF) {
+            put_header(log_record_type::EXECUTION_FULL, (std::uint8_t)kind, 0);
+            put_word(time);
+            put_word(duration);
+            put_word(operand);
+        } else if(operand != 0) {
+            put_header(log_record_type::EXECUTION_OPERAND, (std::uint8_t)kind, duration);
+            put_word(operand);
+        } else {
+            put_header(log_record_type::EXECUTION, (std::uint8_t)kind, duration);
+        }
+        next_time = time + duration;
+    }
+
+    void system_status(int time, trace_op trace, int duration, const process_table& processes,
+                       int running, waiting_view waiting) override {
+        PROFILE_SCOPE(FORMAT);
+        if(!failure.empty()) {
+            return;
+        }
+        std::uint16_t running_name = name_id(processes, processes.program[running]);
+        for(int slot : waiting) {
+            name_id(processes, processes.program[slot]);
+        }
+        if(!failure.empty()) {
+            return;
+        }
+
+        put_header(log_record_type::STATUS, (std::uint8_t)trace, 0);
+        put_word(time);
+        put_word(duration);
+        put_word(1 + waiting.size());
+        put_row(processes, running, running_name);
+        for(int slot : waiting) {
+            put_row(processes, slot, names[processes.program[slot]]);
+        }
+    }
+
+    void core_changed(int core) override {
+        if(!failure.empty()) {
+            return;
+        }
+        put_header(log_record_type::CORE, 0, core);
+    }
+
+private:
+    void put_header(log_record_type type, std::uint8_t code, std::uint16_t small) {
+        log_record record{(std::uint8_t)type, code, small};
+        out.put(std::string_view((const char*)&record, sizeof(record)));
+    }
+
+    void put_word(std::int32_t value) {
+        out.put(std::string_view((const char*)&value, sizeof(value)));
+    }
+
+    void put_row(const process_table& processes, int slot, std::uint16_t name) {
+        put_header(log_record_type::PCB_ROW, 0, name);
+        put_word(processes.PID[slot]);
+        put_word(processes.partition_number[slot]);
+        put_word(processes.size[slot]);
+    }
+
+    void put_string(string_kind kind, size_t id, std::string_view text) {
+        put_header(log_record_type::STRING, (std::uint8_t)kind, 0);
+        put_word(id);
+        put_word(text.size());
+        out.put(text);
+        const char zeros[sizeof(log_record)] = {};
+        out.put(std::string_view(zeros, (sizeof(log_record) - text.size() % sizeof(log_record)) % sizeof(log_record)));
+    }
+
+    //Log id of a program of the process table, writing its name to the log the first
+    //time it is seen. Past the last id the log fails instead, and 0 comes back.
+    std::uint16_t name_id(const process_table& processes, int program) {
+        if((size_t)program >= names.size()) {
+            names.resize(program + 1, -1);
+        }
+        if(names[program] == -1) {
+            if(next_name > 0xFFFF) {
+                failure = "Too many program names for a binary log";
+                return 0;
+            }
+            names[program] = next_name++;
+            put_string(string_kind::PROGRAM_NAME, names[program], processes.program_name(program));
+        }
+        return names[program];
+    }
+
+    buffered_writer                     out;
+    const std::vector<std::string>&     vectors;
+    std::vector<int>                    names;          //!< log id of each program id, -1 until written
+    int                                 next_name = 0;
+    int                                                 next_time = 0;  //!< when the next event is expected
+    std::string                         failure;
+};
+
+/**
+ * \brief replay a binary event log into a sink
+ *
+ * The vector table is at the start of the log, so the sink is only made once it has
+ * been read: 'open_sink' gets the vector table and returns the sink, or nullptr if it
+ * could not make one. A log that is not valid exits with an error.
+ * 
+ * @param log_file the binary event log
+ * @param open_sink makes the sink the events go to; it has to outlive the replay
+ * @return false if open_sink failed
+ * 
+ */
+bool replay_binary_log(const std::string& log_file,
+                       const std::function<event_sink*(const std::vector<std::string>& vectors)>& open_sink);
+
+/**
+ * \brief render a binary event log as the execution and system status text
+ *
+ * The events are replayed into a text_log_sink, so the text is exactly what a text
+ * log of the same simulation would have contained.
+ * 
+ * @param log_file the binary event log
+ * @param execution_file where the execution log goes
+ * @param status_file where the system status log goes
+ * @return false if the text files could not be opened
+ * 
+ */
+bool render_binary_log(const std::string& log_file, const std::string& execution_file,
+                       const std::string& status_file);
+
+/**
+ * \brief aggregates a simulation instead of logging it
+ *
+ * Keeps counters only: simulated time split between user mode (CPU bursts) and
+ * kernel mode (everything else), ISR time per device, mode and process switches,
+ * and how long each partition was occupied. It asks for no details, so the
+ * simulation does not build any process tables either.
+ */
+class stats_sink : public event_sink {
+public:
+    //Per device: interrupts raised and time spent in their ISRs
+    struct device_stats {
+        std::uint64_t   syscalls = 0;
+        std::uint64_t   end_ios = 0;
+        std::uint64_t   coalesced = 0;      //!< end of I/O handled in an interrupt taken for another
+        std::uint64_t   isr_time = 0;
+    };
+
+    //Per partition: when it was last taken and how long it has been occupied in total
+    struct partition_stats {
+        unsigned int    size = 0;
+        int             occupied_since = -1;    //!< -1 while free
+        std::uint64_t   occupied_time = 0;
+    };
+
+    //Per core (only simulate_multicore reports cores): time spent busy and idle
+    struct core_stats {
+        std::uint64_t   busy = 0;
+        std::uint64_t   idle = 0;
+    };
+
+    //Per process that exited (only simulate_scheduled reports them)
+    struct exit_stats {
+        unsigned int    pid;
+        std::string     program;
+        int             turnaround;
+        int             wait;
+        int             response;
+    };
+
+    stats_sink(const std::vector<int>& delays, const std::vector<memory_partition_t>& partitions):
+        devices(delays.size()), partitions(partitions.size()) {
+        for(size_t i = 0; i < partitions.size(); i++) {
+            this->partitions[i].size = partitions[i].size;
+        }
+    }
+
+    void execution(int time, int duration, event_kind kind, int operand) override {
+        end_time = std::max<std::int64_t>(end_time, (std::int64_t)time + duration);
+        if(core != -1) {
+            (kind == event_kind::CPU_IDLE ? cores[core].idle : cores[core].busy) += duration;
+        }
+
+        switch(kind) {
+            case event_kind::CPU_BURST:
+                user_time += duration;
+                return;
+            case event_kind::CPU_IDLE:
+                idle_time += duration;
+                return;
+            case event_kind::MEMORY_WAIT:
+                memory_wait += duration;
+                return;
+            case event_kind::END_IO_COALESCED:
+                device(vector).coalesced++;
+                coalescing_saved += operand;
+                return;
+            case event_kind::SWITCH_TO_KERNEL:
+                mode_switches++;
+                break;
+            case event_kind::FIND_VECTOR:
+                //every interrupt looks its vector up first, so this is the device of the ISR that follows
+                vector = operand;
+                break;
+            case event_kind::SYSCALL_ISR:
+            case event_kind::RUN_SYSCALL_ISR:
+            case event_kind::START_IO:
+                device(vector).syscalls++;
+                device(vector).isr_time += duration;
+                break;
+            case event_kind::ENDIO_ISR:
+            case event_kind::RUN_ENDIO_ISR:
+                device(vector).end_ios++;
+                device(vector).isr_time += duration;
+                break;
+            case event_kind::SCHEDULER_CALLED:
+                process_switches++;
+                break;
+            case event_kind::FORK_PARTITION_ERROR:
+            case event_kind::EXEC_NOT_FOUND_ERROR:
+            case event_kind::EXEC_PARTITION_ERROR:
+                errors++;
+                break;
+            default:
+                break;
+        }
+        kernel_time += duration;
+    }
+
+    void system_status(int /*time*/, trace_op /*trace*/, int /*duration*/, const process_table& /*processes*/,
+                       int /*running*/, waiting_view /*waiting*/) override {}
+
+    void partition_changed(int time, int partition_number, bool occupied) override {
+        if(partition_number < 1 || (size_t)partition_number > partitions.size()) {
+            return;
+        }
+
+        partition_stats& partition = partitions[partition_number - 1];
+        if(occupied && partition.occupied_since == -1) {
+            partition.occupied_since = time;
+        } else if(!occupied && partition.occupied_since != -1) {
+            partition.occupied_time += time - partition.occupied_since;
+            partition.occupied_since = -1;
+        }
+    }
+
+    void process_exited(int time, const process_table& processes, int slot, const process_times& times) override {
+        exits.push_back({processes.PID[slot], processes.program_name(processes.program[slot]),
+                         time - times.arrival, times.wait, times.first_run - times.arrival});
+    }
+
+    void core_changed(int core) override {
+        if((size_t)core >= cores.size()) {
+            cores.resize(core + 1);
+        }
+        this->core = core;
+    }
+
+    bool wants_details() const override {
+        return false;
+    }
+
+    //Reports how many end of I/O were coalesced even if none were
+    void report_coalescing() {
+        coalescing = true;
+    }
+
+    //Writes the report; partitions still occupied count as occupied up to the end
+    void report(std::ostream& out) const {
+        out << "total time: " << end_time << "\n"
+            << "user time: " << user_time << "\n"
+            << "kernel time: " << kernel_time << "\n";
+        if(idle_time > 0) {
+            out << "idle time: " << idle_time << "\n";
+        }
+        if(memory_wait > 0) {
+            out << "memory wait: " << memory_wait << "\n";
+        }
+        out << "mode switches: " << mode_switches << "\n"
+            << "process switches: " << process_switches << "\n"
+            << "errors: " << errors << "\n";
+
+        //with coalescing, the end of I/O not coalesced are the interrupts taken for them
+        std::uint64_t end_ios = 0, coalesced = 0;
+        for(const auto& stats : devices) {
+            end_ios += stats.end_ios;
+            coalesced += stats.coalesced;
+        }
+        const bool coalescing = this->coalescing || coalesced > 0;
+        if(coalescing) {
+            out << "end of I/O: " << end_ios << " in " << end_ios - coalesced << " interrupt(s), " << coalesced
+                << " coalesced, " << coalescing_saved << " kernel time saved\n";
+        }
+
+        for(size_t i = 0; i < devices.size(); i++) {
+            const device_stats& stats = devices[i];
+            if(stats.syscalls + stats.end_ios > 0) {
+                out << "device " << i << ": " << stats.syscalls << " syscall(s), " << stats.end_ios << " end of I/O";
+                if(coalescing) {
+                    out << " (" << stats.coalesced << " coalesced)";
+                }
+                out << ", " << stats.isr_time << " ISR time\n";
+            }
+        }
+
+        for(size_t i = 0; i < cores.size(); i++) {
+            char utilization[16];
+            snprintf(utilization, sizeof(utilization), "%.1f%%", end_time > 0 ? 100.0 * cores[i].busy / end_time : 0.0);
+            out << "core " << i << ": " << cores[i].busy << " busy, " << cores[i].idle << " idle, "
+                << utilization << " utilization\n";
+        }
+
+        for(size_t i = 0; i < partitions.size(); i++) {
+            const partition_stats& stats = partitions[i];
+            std::uint64_t occupied = stats.occupied_time;
+            if(stats.occupied_since != -1) {
+                occupied += end_time - stats.occupied_since;
+            }
+            char utilization[16];
+            snprintf(utilization, sizeof(utilization), "%.1f%%", end_time > 0 ? 100.0 * occupied / end_time : 0.0);
+            out << "partition " << i + 1 << " (" << stats.size << " Mb): " << occupied << " occupied, "
+                << utilization << "\n";
+        }
+
+        //per process, in the order they exited, then the averages
+        double turnaround = 0, wait = 0, response = 0;
+        for(const auto& process : exits) {
+            out << "process " << process.pid << " (" << process.program << "): "
+                << process.turnaround << " turnaround, " << process.wait << " wait, "
+                << process.response << " response\n";
+            turnaround += process.turnaround;
+            wait += process.wait;
+            response += process.response;
+        }
+        if(!exits.empty()) {
+            char averages[96];
+            snprintf(averages, sizeof(averages), "average: %.1f turnaround, %.1f wait, %.1f response\n",
+                     turnaround / exits.size(), wait / exits.size(), response / exits.size());
+            out << averages;
+        }
+    }
+
+private:
+    //Grows the table rather than trusting the device number
+    device_stats& device(int number) {
+        if(number >= 0 && (size_t)number >= devices.size()) {
+            devices.resize(number + 1);
+        }
+        return devices[number < 0 ? 0 : number];
+    }
+
+    std::int64_t                    end_time = 0;
+    std::uint64_t                   user_time = 0;
+    std::uint64_t                   kernel_time = 0;
+    std::uint64_t                   idle_time = 0;
+    std::uint64_t                   memory_wait = 0;
+    std::uint64_t                   mode_switches = 0;
+    std::uint64_t                   process_switches = 0;
+    std::uint64_t                   errors = 0;
+    std::uint64_t                   coalescing_saved = 0;   //!< kernel time END_IO coalescing saved
+    bool                            coalescing = false;
+    int                             vector = 0;
+    int                             core = -1;
+    std::vector<device_stats>       devices;
+    std::vector<core_stats>         cores;
+    std::vector<partition_stats>    partitions;
+    std::vector<exit_stats>         exits;
+};
+
+/**
+ * \brief the execution events of a simulation, one array per field
+ *
+ * Each event also gets the device of the interrupt it belongs to (the operand of the
+ * last FIND_VECTOR), so per device sums need no state. analyze_timeline runs over the
+ * columns; it works the same on a live simulation and a replayed binary log.
+ */
+class timeline_sink : public event_sink {
+public:
+    void execution(int time, int duration, event_kind kind, int operand) override {
+        if(kind == event_kind::FIND_VECTOR) {
+            device = operand;
+        }
+        times.push_back(time);
+        durations.push_back(duration);
+        kinds.push_back((std::uint8_t)kind);
+        devices.push_back(device);
+    }
+
+    void system_status(int /*time*/, trace_op /*trace*/, int /*duration*/, const process_table& /*processes*/,
+                       int /*running*/, waiting_view /*waiting*/) override {}
+
+    bool wants_details() const override {
+        return false;
+    }
+
+    size_t size() const {
+        return times.size();
+    }
+
+    std::vector<std::int32_t>   times;
+    std::vector<std::int32_t>   durations;
+    std::vector<std::uint8_t>   kinds;
+    std::vector<std::int32_t>   devices;    //!< -1 before the first interrupt
+
+private:
+    int device = -1;
+};
+
+//What analyze_timeline works out
+struct timeline_analysis {
+    static constexpr size_t kind_count = (size_t)last_event_kind + 1;
+
+    size_t                                  events = 0;
+    std::int64_t                            total_time = 0;
+    std::array<std::int64_t, kind_count>    busy{};         //!< time spent per event kind
+    std::array<std::uint64_t, kind_count>   counts{};
+    std::uint64_t                           interrupts = 0;
+    std::int64_t                            min_latency = 0;
+    std::int64_t                            max_latency = 0;
+    std::int64_t                            total_latency = 0;
+    std::vector<std::uint64_t>              latency_histogram;  //!< bucket b: latencies of b bits
+    std::vector<std::int64_t>               device_busy;        //!< ISR time per device
+};
+
+//Latest end (time + duration) of the events; branch free so the compiler can vectorize it
+std::int64_t max_end(const std::int32_t* times, const std::int32_t* durations, size_t count);
+
+/**
+ * \brief busy time per activity, interrupt latencies and device utilization of a timeline
+ *
+ * Every aggregate is one pass over whole columns, adding into tables small enough to
+ * stay in cache. An interrupt runs from the switch to kernel mode to the end of its
+ * IRET, and its latency is that span; the histogram has one bucket per bit width of the
+ * latency. The time of a device is the time spent in its ISRs (and starting its I/O,
+ * with overlapped I/O).
+ *
+ * @param timeline the events
+ * @return the aggregates
+ *
+ */
+timeline_analysis analyze_timeline(const timeline_sink& timeline);
+
+//Writes what analyze_timeline worked out
+void report_timeline(std::ostream& out, const timeline_analysis& analysis);
+
+/**
+ * \brief analyze a binary event log, as --analyze would have the simulation itself
+ *
+ * @param log_file the binary event log
+ * @param analysis_file where the report of analyze_timeline goes
+ * @return false if the log could not be read or the report could not be opened
+ *
+ */
+bool analyze_binary_log(const std::string& log_file, const std::string& analysis_file);
+
+//Times of the fixed steps of entering and leaving the kernel, as the assignment has them
+struct standard_kernel_costs {
+    static constexpr int switch_to_kernel   = 1;
+    static constexpr int context_save       = 10;
+    static constexpr int find_vector        = 1;
+    static constexpr int load_address       = 1;
+    static constexpr int iret               = 1;
+    static constexpr int context_restore    = 10;
+    static constexpr int switch_to_user     = 1;
+
+    //ISR work of overlapped I/O (see simulate_scheduled): starting a request on a
+    //device, and handling the interrupt of its completion
+    static constexpr int start_io           = 1;
+    static constexpr int complete_io        = 1;
+
+    //Steps of an EXEC: loading takes this much per unit of program size
+    static constexpr int load_per_size      = 15;
+    static constexpr int mark_partition     = 3;
+    static constexpr int update_pcb         = 6;
+};
+
+//A CPU that saves and restores the context in hardware, in a single step each
+struct hardware_save_kernel_costs : standard_kernel_costs {
+    static constexpr int context_save       = 1;
+    static constexpr int context_restore    = 1;
+};
+
+//Kernel cost models the simulator can be run with
+enum class kernel_cost_model { STANDARD, HARDWARE_SAVE };
+
+//SERIAL: a SYSCALL holds the CPU for the whole I/O, as the assignment has it.
+//OVERLAPPED: devices complete on their own and other processes run meanwhile.
+enum class io_model { SERIAL, OVERLAPPED };
+
+//RUN_TO_COMPLETION: a FORK child or exec'd program runs until it is done, as the
+//assignment has it. The others pick among the ready processes (see simulate_scheduled).
+enum class scheduling_policy { RUN_TO_COMPLETION, FCFS, ROUND_ROBIN, PRIORITY, MULTILEVEL_FEEDBACK };
+
+//How a simulation runs, apart from the tables it reads
+struct simulation_options {
+    kernel_cost_model   costs = kernel_cost_model::STANDARD;
+    io_model            io = io_model::SERIAL;
+    scheduling_policy   scheduler = scheduling_policy::RUN_TO_COMPLETION;
+    int                 quantum = 50;       //!< round robin and the top multilevel feedback queue
+    bool                memoize_exec = false;   //!< replay exec'd programs (see exec_memo); run to completion only
+    int                 cores = 1;          //!< more than one runs simulate_multicore
+    int                 coalesce_window = -1;   //!< END_IOs of a device within it share an interrupt; -1 never
+};
+
+/**
+ * \brief what a simulation does, apart from how long anything takes
+ *
+ * Nothing simulate_trace decides depends on the time, so one run per partition table
+ * tells the time of the run under any delays and context save time: the time of the
+ * run is fixed work, plus one context save per interrupt, plus one delay per ISR of
+ * each device. This counts those, so a sweep can work the time out instead of running
+ * the simulation again. Only the standard kernel cost model runs through it.
+ */
+class structure_sink : public event_sink {
+public:
+    void execution(int time, int duration, event_kind kind, int operand) override {
+        end_time = std::max<std::int64_t>(end_time, (std::int64_t)time + duration);
+
+        switch(kind) {
+            case event_kind::CONTEXT_SAVED:
+                context_saves++;
+                break;
+            case event_kind::FIND_VECTOR:
+                vector = operand;
+                break;
+            case event_kind::SYSCALL_ISR:
+            case event_kind::ENDIO_ISR:
+                if(vector < 0) {
+                    break;
+                }
+                if((size_t)vector >= isrs.size()) {
+                    isrs.resize(vector + 1);
+                }
+                isrs[vector]++;
+                break;
+            case event_kind::FORK_PARTITION_ERROR:
+            case event_kind::EXEC_PARTITION_ERROR:
+                allocation_failures++;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void system_status(int /*time*/, trace_op /*trace*/, int /*duration*/, const process_table& /*processes*/,
+                       int /*running*/, waiting_view /*waiting*/) override {}
+
+    bool wants_details() const override {
+        return false;
+    }
+
+    //The time of the run with 'delays' scaled to 'delay_scale' percent and a context save of
+    //'context_save'; 'delays' (and 'run_delays', the ones of the run) cover every device it used
+    std::int64_t total_time(const std::vector<int>& run_delays, const std::vector<int>& delays,
+                            int delay_scale, int context_save) const {
+        std::int64_t time = end_time + (std::int64_t)context_saves * (context_save - standard_kernel_costs::context_save);
+        for(size_t device = 0; device < isrs.size(); device++) {
+            time += (std::int64_t)isrs[device] * ((std::int64_t)delays[device] * delay_scale / 100 - run_delays[device]);
+        }
+        return time;
+    }
+
+    //Highest device number the run raised an ISR of, -1 for none
+    int last_device() const {
+        for(size_t device = isrs.size(); device > 0; device--) {
+            if(isrs[device - 1] > 0) {
+                return device - 1;
+            }
+        }
+        return -1;
+    }
+
+    std::uint64_t failures() const {
+        return allocation_failures;
+    }
+
+private:
+    std::int64_t                end_time = 0;
+    std::uint64_t               context_saves = 0;
+    std::uint64_t               allocation_failures = 0;
+    int                         vector = 0;
+    std::vector<std::uint64_t>  isrs;       //!< SYSCALL and END_IO ISRs per device
+};
+
+/**
+ * \brief the fixed interrupt sequences of a kernel cost model
+ *
+ * The offset of every step is a constant of the instantiation, so running a sequence
+ * only adds the base time. 'costs' is a struct like standard_kernel_costs.
+ */
+template<class costs>
+struct interrupt_sequence {
+    static constexpr int context_save_at    = costs::switch_to_kernel;
+    static constexpr int find_vector_at     = context_save_at + costs::context_save;
+    static constexpr int load_address_at    = find_vector_at + costs::find_vector;
+    static constexpr int entry_time         = load_address_at + costs::load_address;
+
+    static constexpr int context_restore_at = costs::iret;
+    static constexpr int switch_to_user_at  = context_restore_at + costs::context_restore;
+    static constexpr int exit_time          = switch_to_user_at + costs::switch_to_user;
+
+    //Switch to kernel mode, save the context and load the ISR address of 'vector';
+    //returns the time at which the ISR address is in the PC
+    static int enter(int time, int vector, event_sink& sink) {
+        sink.execution(time, costs::switch_to_kernel, event_kind::SWITCH_TO_KERNEL);
+        sink.execution(time + context_save_at, costs::context_save, event_kind::CONTEXT_SAVED);
+        sink.execution(time + find_vector_at, costs::find_vector, event_kind::FIND_VECTOR, vector);
+        sink.execution(time + load_address_at, costs::load_address, event_kind::LOAD_ADDRESS, vector);
+        return time + entry_time;
+    }
+
+    //Return from the ISR; returns the time after it
+    static int iret(int time, event_sink& sink) {
+        sink.execution(time, costs::iret, event_kind::IRET);
+        return time + costs::iret;
+    }
+
+    //IRET, restore the context and switch back to user mode; returns the time after it
+    static int leave(int time, event_sink& sink) {
+        sink.execution(time, costs::iret, event_kind::IRET);
+        sink.execution(time + context_restore_at, costs::context_restore, event_kind::CONTEXT_RESTORED);
+        sink.execution(time + switch_to_user_at, costs::switch_to_user, event_kind::SWITCH_TO_USER);
+        return time + exit_time;
+    }
+
+    //What an END_IO coalesced into an interrupt already taken does without: entering
+    //the kernel and the IRET
+    static constexpr int coalesced_saving = entry_time + costs::iret;
+
+    //With coalescing on (a window of 0 or more), the END_IOs of 'device' right after 'pc'
+    //in 'code' run their ISRs in the interrupt entered at 'entered', for as long as the
+    //ISRs so far end within 'window' of it. Moves 'pc' past them; returns the time after.
+    static int coalesce_end_ios(instr_span code, size_t& pc, int device, int entered, int time, int window,
+                                const std::vector<int>& delays, event_sink& sink) {
+        while(window >= 0 && pc < code.size() && code[pc].op == trace_op::END_IO && code[pc].operand == device
+              && time - entered <= window) {
+            pc++;
+            sink.execution(time, 0, event_kind::END_IO_COALESCED, coalesced_saving);
+            sink.execution(time, delays[device], event_kind::ENDIO_ISR);
+            time += delays[device];
+        }
+        return time;
+    }
+};
+
+//Helper function for a sanity check. Prints the external files table
+void print_external_files(const std::vector<external_file>& files);
+
+//This function takes as input: the current PCB and the waitqueue (which is a
+//std::vector of the PCB struct); the function returns the information as a table
+std::string print_PCB(const PCB& current, const std::vector<PCB>& _PCB);
+
+
+// Searches the external_files table and returns the size of the program
+unsigned int get_size(const std::string& name, const std::vector<external_file>& external_files);
+
+//The debug line of an EXEC, for sinks that want details
+void print_exec_debug(const std::string& program_name);
+
+/**
+ * \brief memoized runs of exec'd programs, for simulate_trace
+ *
+ * What a program does once exec'd only depends on the program, which partitions are
+ * occupied, the PCB of the process and the PCBs of the wait queue (they show in the
+ * system status tables, and decide the PIDs of children). Keyed on those, the first
+ * run is recorded as events relative to its start; a later run from the same state
+ * replays them at its own time and leaves memory and the PCB as the first one did.
+ *
+ * It sits between simulate_trace and the real sink, and passes everything on. Each
+ * recording keeps its events, so 'max_events' caps what the cache holds in total;
+ * past it, programs run as usual.
+ */
+class exec_memo : public event_sink {
+public:
+    exec_memo(event_sink& next, const symbol_table& symbols, size_t max_events = 1 << 22):
+        next(next), scratch(symbols), max_events(max_events) {}
+
+    void execution(int time, int duration, event_kind kind, int operand) override {
+        if(!active.empty()) {
+            tape.push_back({memo_event::EXECUTION, (std::uint8_t)kind, false, time, duration, operand, 0});
+        }
+        next.execution(time, duration, kind, operand);
+    }
+
+    void system_status(int time, trace_op trace, int duration, const process_table& processes,
+                       int running, waiting_view waiting) override {
+        if(!active.empty()) {
+            tape.push_back({memo_event::STATUS, (std::uint8_t)trace, waiting.head != -1, time, duration, 0,
+                            (std::uint32_t)(1 + waiting.size())});
+            tape_rows.push_back(memo_row::of(processes, running));
+            for(int slot : waiting) {
+                tape_rows.push_back(memo_row::of(processes, slot));
+            }
+        }
+        next.system_status(time, trace, duration, processes, running, waiting);
+    }
+
+    void partition_changed(int time, int partition_number, bool occupied) override {
+        if(!active.empty()) {
+            tape.push_back({memo_event::PARTITION, 0, occupied, time, 0, partition_number, 0});
+        }
+        next.partition_changed(time, partition_number, occupied);
+    }
+
+    void process_exited(int time, const process_table& processes, int slot, const process_times& times) override {
+        next.process_exited(time, processes, slot, times);
+    }
+
+    bool wants_details() const override {
+        return next.wants_details();
+    }
+
+    void exec_debug_line(const std::string& program_name) override {
+        next.exec_debug_line(program_name);
+    }
+
+    //The debug line of an EXEC of 'program' (a symbol id)
+    void exec_debug(int time, int program) {
+        if(!active.empty()) {
+            tape.push_back({memo_event::EXEC_DEBUG, 0, false, time, 0, program, 0});
+        }
+        next.exec_debug_line(scratch.program_name(program));
+    }
+
+    /**
+     * \brief runs the program 'running' was just exec'd into from the cache, if it can
+     *
+     * @param time when the program starts; moved to when it finishes on a hit
+     * @param memory the partitions, which end up as the recorded run left them
+     * @param processes the process table; the row of 'running' holds the program
+     * @param running slot of the process
+     * @param wait_queue the processes waiting on it
+     * @param recording on a miss, what to end with finish() once the program is done
+     *                  (-1 if the cache is full)
+     * @return true if the program was replayed
+     */
+    bool replay(int& time, partition_manager& memory, process_table& processes, int running,
+                const process_queue& wait_queue, int& recording) {
+        make_key(memory, processes, running, wait_queue);
+
+        auto it = cache.find(key);
+        if(it == cache.end()) {
+            recording = -1;
+            if(cached_events < max_events) {
+                active.push_back({std::move(key), time, tape.size(), tape_rows.size()});
+                recording = active.size() - 1;
+            }
+            return false;
+        }
+
+        send(it->second, time);
+        memory.set_occupancy(it->second.occupancy);
+        processes.program[running] = it->second.program;
+        processes.size[running] = it->second.size;
+        processes.partition_number[running] = it->second.partition_number;
+        time += it->second.duration;
+        return true;
+    }
+
+    //Ends the recording 'id' of replay(): the program finished at 'time', and memory and
+    //the row of 'running' are as it left them
+    void finish(int id, int time, const partition_manager& memory, const process_table& processes, int running) {
+        recording& done = active[id];
+
+        memo_entry entry;
+        entry.events.assign(tape.begin() + done.tape_start, tape.end());
+        for(auto& event : entry.events) {
+            event.time -= done.start;
+        }
+        entry.rows.assign(tape_rows.begin() + done.rows_start, tape_rows.end());
+        entry.duration = time - done.start;
+        entry.occupancy = memory.occupancy();
+        entry.program = processes.program[running];
+        entry.size = processes.size[running];
+        entry.partition_number = processes.partition_number[running];
+
+        cached_events += entry.events.size();
+        cache.emplace(std::move(done.key), std::move(entry));
+
+        active.pop_back();
+        if(active.empty()) {
+            tape.clear();
+            tape_rows.clear();
+        }
+    }
+
+private:
+    struct memo_event {
+        enum type_t : std::uint8_t { EXECUTION, STATUS, PARTITION, EXEC_DEBUG };
+
+        type_t          type;
+        std::uint8_t    code;       //!< event_kind, or trace_op of a STATUS
+        bool            flag;       //!< occupied, or a STATUS with a head
+        int             time;       //!< since the start of the recording, once it is done
+        int             duration;
+        int             operand;    //!< partition number of a PARTITION, program of an EXEC_DEBUG
+        std::uint32_t   rows;       //!< PCBs of a STATUS (running first, then waiting)
+    };
+
+    struct memo_row {
+        unsigned int    PID;
+        int             PPID;
+        int             program;
+        unsigned int    size;
+        int             partition_number;
+
+        static memo_row of(const process_table& processes, int slot) {
+            return {processes.PID[slot], processes.PPID[slot], processes.program[slot], processes.size[slot],
+                    processes.partition_number[slot]};
+        }
+    };
+
+    //A recorded run and the state it left
+    struct memo_entry {
+        std::vector<memo_event>     events;
+        std::vector<memo_row>       rows;
+        int                         duration = 0;
+        std::vector<std::uint64_t>  occupancy;
+        int                         program = 0;
+        unsigned int                size = 0;
+        int                         partition_number = -1;
+    };
+
+    //A run being recorded; the ones nested in it are recorded too
+    struct recording {
+        std::vector<std::uint64_t>  key;
+        int                         start;
+        size_t                      tape_start;
+        size_t                      rows_start;
+    };
+
+    struct key_hash {
+        size_t operator()(const std::vector<std::uint64_t>& words) const {
+            std::uint64_t hash = 1469598103934665603ull;
+            for(std::uint64_t word : words) {
+                hash = (hash ^ word) * 1099511628211ull;
+            }
+            return hash;
+        }
+    };
+
+    void make_key(const partition_manager& memory, const process_table& processes, int running,
+                  const process_queue& wait_queue) {
+        key.clear();
+        auto add_row = [&](int slot) {
+            key.push_back(processes.PID[slot]);
+            key.push_back((std::uint32_t)processes.PPID[slot]);
+            key.push_back(processes.program[slot]);
+            key.push_back(processes.size[slot]);
+            key.push_back((std::uint32_t)processes.partition_number[slot]);
+        };
+
+        add_row(running);
+        key.push_back(wait_queue.entries().size());
+        for(int slot : wait_queue.entries()) {
+            add_row(slot);
+        }
+        key.insert(key.end(), memory.occupancy().begin(), memory.occupancy().end());
+    }
+
+    //Sends the recorded events on (through this sink, so runs being recorded get them too)
+    void send(const memo_entry& entry, int start) {
+        size_t next_row = 0;
+        for(const auto& event : entry.events) {
+            const int time = start + event.time;
+            switch(event.type) {
+                case memo_event::EXECUTION:
+                    execution(time, event.duration, (event_kind)event.code, event.operand);
+                    break;
+                case memo_event::STATUS: {
+                    //the PCBs go in slots 0... of a table of their own
+                    for(std::uint32_t i = 0; i < event.rows; i++) {
+                        const memo_row& row = entry.rows[next_row + i];
+                        if(i < scratch.PID.size()) {
+                            scratch.set(i, row.PID, row.PPID, row.program, row.size, row.partition_number);
+                        } else {
+                            scratch.add(row.PID, row.PPID, row.program, row.size, row.partition_number);
+                        }
+                    }
+                    next_row += event.rows;
+
+                    scratch_queue.clear();
+                    for(std::uint32_t i = event.flag ? 2 : 1; i < event.rows; i++) {
+                        scratch_queue.push_back(i);
+                    }
+                    system_status(time, (trace_op)event.code, event.duration, scratch, 0,
+                                  {event.flag ? 1 : -1, scratch_queue});
+                    break;
+                }
+                case memo_event::PARTITION:
+                    partition_changed(time, event.operand, event.flag);
+                    break;
+                case memo_event::EXEC_DEBUG:
+                    exec_debug(time, event.operand);
+                    break;
+            }
+        }
+    }
+
+    event_sink&                     next;
+    process_table                   scratch;        //!< PCBs of the system status being replayed
+    std::vector<int>                scratch_queue;
+    size_t                          max_events;
+    size_t                          cached_events = 0;
+    std::vector<std::uint64_t>      key;
+    std::vector<recording>          active;         //!< innermost last
+    std::vector<memo_event>         tape;           //!< events since the outermost recording began
+    std::vector<memo_row>           tape_rows;
+    std::unordered_map<std::vector<std::uint64_t>, memo_entry, key_hash> cache;
+};
+
+//A process of a checkpoint, as the process table has it
+struct checkpoint_process {
+    unsigned int    PID;
+    int             PPID;
+    int             program;            //!< index into the names of the checkpoint
+    unsigned int    size;
+    int             partition_number;
+};
+
+//A process_frame of a checkpoint: the program stands in for the trace pointer
+struct checkpoint_frame {
+    int             program;            //!< index into the names of the checkpoint, -1 for the trace simulated
+    int             block;
+    std::uint64_t   pc;
+    int             process;
+    int             release_partition;
+    bool            parent_waiting;
+    bool            owns_process;
+};
+
+/**
+ * \brief everything simulate_trace needs to go on from between two instructions
+ *
+ * The partitions, the process table (free slots included, so children get the slots
+ * they would have), the wait queue and the process stack, plus the time and how much
+ * of each log had been written. Programs are stored by name, so a checkpoint can be
+ * resumed by a run that interned its symbols in another order.
+ */
+struct simulation_checkpoint {
+    std::uint64_t                   trace_hash = 0;         //!< of the trace simulated (see trace_fingerprint)
+    std::uint64_t                   steps = 0;              //!< instructions run before it
+    int                             time = 0;
+    std::uint64_t                   execution_offset = 0;   //!< bytes of the execution log written before it
+    std::uint64_t                   status_offset = 0;      //!< bytes of the system status log written before it
+    std::uint64_t                   partition_count = 0;
+    std::vector<std::uint64_t>      occupancy;              //!< as partition_manager::occupancy
+    std::vector<std::string>        names;                  //!< program names, by the index the rest uses
+    std::vector<checkpoint_process> processes;              //!< by slot
+    std::vector<int>                free_slots;
+    std::vector<int>                wait_queue;             //!< slots, the most recent last
+    std::vector<checkpoint_frame>   frames;                 //!< the bottom of the stack first
+};
+
+const char CHECKPOINT_MAGIC[8] = {'I', 'C', 'H', 'E', 'C', 'K', '\0', '1'};
+
+//FNV-1a of the instructions, blocks, forks and program names of a trace
+std::uint64_t trace_fingerprint(const compiled_trace& trace);
+
+/**
+ * \brief write a checkpoint, replacing 'filename' only once it is complete
+ *
+ * The fields are written one by one in the byte order of the machine, after a header
+ * of CHECKPOINT_MAGIC and a byte order mark; vectors are a count and their elements.
+ * The checkpoint goes to 'filename'.tmp first and is renamed over 'filename', so a
+ * run killed while it writes still has the checkpoint before.
+ *
+ * @param checkpoint what to write
+ * @param filename the checkpoint file
+ * @return false if the file could not be written
+ *
+ */
+bool write_checkpoint(const simulation_checkpoint& checkpoint, const std::string& filename);
+
+/**
+ * \brief read a checkpoint written by write_checkpoint
+ *
+ * Only the layout is checked here: whether it fits the trace and the tables of the
+ * run is up to restore_checkpoint.
+ *
+ * @param filename the checkpoint file
+ * @return the checkpoint
+ *
+ */
+simulation_checkpoint load_checkpoint(const std::string& filename);
+
+//Cuts a log back to the 'size' bytes a checkpoint says were written. Returns false if
+//the file is missing or shorter than that.
+bool truncate_log(const std::string& filename, std::uint64_t size);
+
+//The state of simulate_trace between two instructions, as a checkpoint
+simulation_checkpoint capture_checkpoint(const std::vector<process_frame>& frames, std::uint64_t steps, int time,
+                                         const symbol_table& symbols, const partition_manager& memory,
+                                         const process_table& processes, const process_queue& wait_queue);
+
+/**
+ * \brief puts the state of a checkpoint back, for simulate_trace to go on from
+ *
+ * Fails if the checkpoint is not one of 'trace' or the partition table has another
+ * number of partitions, or anything in it is out of range. The delays can differ from
+ * the run that took it, for what-if runs from one shared prefix.
+ *
+ * @param checkpoint the checkpoint
+ * @param trace the trace it was taken of
+ * @param context the tables of this run
+ * @param memory the partitions, which end up as the checkpoint has them
+ * @param processes an empty process table, filled from the checkpoint
+ * @param wait_queue an empty wait queue, filled from the checkpoint
+ * @param frames the process stack, if it can be restored
+ * @param error why it cannot, if it cannot
+ * @return false if the checkpoint does not fit this run
+ *
+ */
+bool restore_checkpoint(const simulation_checkpoint& checkpoint, const compiled_trace& trace,
+                        const simulation_context& context, partition_manager& memory, process_table& processes,
+                        process_queue& wait_queue, std::vector<process_frame>& frames, std::string& error);
+
+//When to take checkpoints, and what to resume from
+struct checkpoint_options {
+    std::uint64_t               interval = 0;   //!< instructions between checkpoints, 0 for none
+    std::vector<std::uint64_t>  steps;          //!< instruction counts to keep a checkpoint at
+    std::string                 resume;         //!< checkpoint to go on from, empty to start at time 0
+
+    bool enabled() const {
+        return interval != 0 || !steps.empty() || !resume.empty();
+    }
+};
+
+/**
+ * \brief when simulate_trace takes checkpoints, and where they go
+ *
+ * Every 'interval' instructions (0 for never) a checkpoint replaces 'prefix'.bin, so
+ * that file always has the latest one; at every step of 'steps' one is also written to
+ * 'prefix'_<step>.bin and kept. The log is flushed first, so the files hold everything
+ * the checkpoint says was written to them.
+ */
+class checkpointer {
+public:
+    checkpointer(const compiled_trace& trace, text_log_sink& log, std::string prefix, std::uint64_t interval,
+                 std::vector<std::uint64_t> steps):
+        log(log), prefix(std::move(prefix)), interval(interval), steps(std::move(steps)),
+        trace_hash(trace_fingerprint(trace)) {
+        std::sort(this->steps.begin(), this->steps.end());
+    }
+
+    //True if a checkpoint is due before the instruction 'step' (counting from 0) runs
+    bool due(std::uint64_t step) const {
+        return step != 0 && failure.empty() && ((interval != 0 && step % interval == 0)
+                                                || std::binary_search(steps.begin(), steps.end(), step));
+    }
+
+    //Writes the checkpoint of step 'checkpoint.steps'. If it cannot, no more are taken,
+    //and error() says why.
+    void save(simulation_checkpoint& checkpoint) {
+        log.flush();
+        checkpoint.trace_hash = trace_hash;
+        checkpoint.execution_offset = log.execution_bytes();
+        checkpoint.status_offset = log.status_bytes();
+
+        std::vector<std::string> files;
+        if(interval != 0 && checkpoint.steps % interval == 0) {
+            files.push_back(prefix + ".bin");
+        }
+        if(std::binary_search(steps.begin(), steps.end(), checkpoint.steps)) {
+            files.push_back(prefix + "_" + std::to_string(checkpoint.steps) + ".bin");
+        }
+        for(const auto& file : files) {
+            if(!write_checkpoint(checkpoint, file)) {
+                failure = "Unable to write checkpoint " + file;
+                return;
+            }
+        }
+    }
+
+    //Why a checkpoint could not be written, empty if every one was
+    const std::string& error() const {
+        return failure;
+    }
+
+private:
+    text_log_sink&              log;
+    std::string                 prefix;
+    std::uint64_t               interval;
+    std::vector<std::uint64_t>  steps;      //!< sorted
+    std::uint64_t               trace_hash;
+    std::string                 failure;
+};
+
+//A device finishing the I/O of a blocked process
+struct io_completion {
+    int             time;
+    unsigned long   sequence;   //!< completions due at the same time come in request order
+    int             process;    //!< engine entry of the process waiting on it
+    int             device;
+
+    bool operator>(const io_completion& other) const {
+        return std::tie(time, sequence) > std::tie(other.time, other.sequence);
+    }
+};
+
+//Devices completing, the earliest first
+using io_timers = std::priority_queue<io_completion, std::vector<io_completion>, std::greater<io_completion>>;
+
+//The partition table of a simulation with one CPU: nothing else ever holds it
+struct private_partitions {
+    partition_manager&  memory;
+
+    //Takes the table, waiting from 'time' if another core holds it
+    void lock(int& /*time*/, event_sink& /*sink*/) {}
+
+    //Lets go of the table at 'time'
+    void unlock(int /*time*/) {}
+
+    //Frees a partition at 'time', telling the sink if it was in use
+    void release(int time, int partition_number, event_sink& sink) {
+        if(!memory.is_free(partition_number)) {
+            memory.free(partition_number);
+            sink.partition_changed(time, partition_number, false);
+        }
+    }
+};
+
+//The partition table the cores of simulate_multicore share: a core that needs it while
+//another holds it logs MEMORY_WAIT, and a partition is freed once no core holds it
+struct shared_partitions {
+    partition_manager&  memory;
+    int                 free_at;    //!< when the core holding the table lets go of it
+
+    void lock(int& time, event_sink& sink) {
+        if(time < free_at) {
+            sink.execution(time, free_at - time, event_kind::MEMORY_WAIT);
+            time = free_at;
+        }
+    }
+
+    void unlock(int time) {
+        free_at = time;
+    }
+
+    void release(int time, int partition_number, event_sink& sink) {
+        if(!memory.is_free(partition_number)) {
+            free_at = std::max(free_at, time);
+            memory.free(partition_number);
+            sink.partition_changed(free_at, partition_number, false);
+        }
+    }
+};
+
+/**
+ * \brief what the kernel does for a trace instruction, in every engine alike
+ *
+ * The engines decide which process runs and keep the time; the interrupts of SYSCALL,
+ * END_IO, FORK and EXEC (and of overlapped I/O) are run here, each moving 'time' past
+ * what it logs. 'partitions' is private_partitions or shared_partitions; 'waiting' is
+ * a callable giving the waiting_view of the system status table, only called if there
+ * is one. 'costs' is a struct like standard_kernel_costs.
+ */
+template<class costs>
+struct kernel_work {
+    using kernel = interrupt_sequence<costs>;
+
+    //A SYSCALL that holds the CPU for the whole I/O of 'device'
+    static void syscall(int& time, int device, const std::vector<int>& delays, event_sink& sink) {
+        time = kernel::enter(time, device, sink);
+
+        sink.execution(time, delays[device], event_kind::SYSCALL_ISR);
+        time += delays[device];
+
+        time = kernel::iret(time, sink);
+    }
+
+    //An END_IO of 'device', and the ones right after 'pc' in 'code' that coalesce into
+    //it within 'window' (see coalesce_end_ios); moves 'pc' past those
+    static void end_io(int& time, int device, instr_span code, size_t& pc, int window,
+                       const std::vector<int>& delays, event_sink& sink) {
+        const int entered = time;
+        time = kernel::enter(time, device, sink);
+
+        sink.execution(time, delays[device], event_kind::ENDIO_ISR);
+        time += delays[device];
+        time = kernel::coalesce_end_ios(code, pc, device, entered, time, window, delays, sink);
+
+        time = kernel::iret(time, sink);
+    }
+
+    //A SYSCALL that starts the I/O of 'device' and gives up the CPU. A device takes one
+    //request at a time; 'device_free' is when each is done with its queue. Returns when
+    //this request completes.
+    static int start_io(int& time, int device, const std::vector<int>& delays, std::vector<int>& device_free,
+                        event_sink& sink) {
+        time = kernel::enter(time, device, sink);
+
+        sink.execution(time, costs::start_io, event_kind::START_IO, device);
+        time += costs::start_io;
+
+        int& busy_until = device_free[device];
+        busy_until = std::max(busy_until, time) + delays[device];
+        const int done = busy_until;
+
+        sink.execution(time, 0, event_kind::SCHEDULER_CALLED);
+        time = kernel::iret(time, sink);
+        return done;
+    }
+
+    //The interrupts of the completions of 'timers' that are due by 'time'. With
+    //coalescing, completions of the same device that are in by then come along, as
+    //coalesce_end_ios has it for END_IO lines. After each interrupt, 'ready' gets the
+    //engine entries whose I/O it completed.
+    template<class ready_fn>
+    static void complete_io(int& time, io_timers& timers, int window, std::vector<int>& completed,
+                            event_sink& sink, ready_fn ready) {
+        while(!timers.empty() && timers.top().time <= time) {
+            const io_completion done = timers.top();
+            timers.pop();
+
+            const int entered = time;
+            time = kernel::enter(time, done.device, sink);
+            sink.execution(time, costs::complete_io, event_kind::RUN_ENDIO_ISR);
+            time += costs::complete_io;
+
+            completed.assign(1, done.process);
+            while(window >= 0 && !timers.empty() && timers.top().device == done.device
+                  && timers.top().time <= time && time - entered <= window) {
+                completed.push_back(timers.top().process);
+                timers.pop();
+                sink.execution(time, 0, event_kind::END_IO_COALESCED, kernel::coalesced_saving);
+                sink.execution(time, costs::complete_io, event_kind::RUN_ENDIO_ISR);
+                time += costs::complete_io;
+            }
+            time = kernel::iret(time, sink);
+
+            for(int entry : completed) {
+                ready(entry);
+            }
+        }
+    }
+
+    //A FORK of 'running': clones its PCB as 'child_pid' into a partition of its own
+    //(taken using best fit) and reports the system status with the child running.
+    //Returns the slot of the child, -1 if no partition had room for it.
+    template<class partitions, class waiting_fn>
+    static int fork(int& time, int duration, int running, unsigned int child_pid, partitions& memory,
+                    process_table& processes, event_sink& sink, waiting_fn waiting) {
+        PROFILE_COUNT(FORKS, 1);
+        time = kernel::enter(time, FORK_VECTOR, sink);
+
+        memory.lock(time, sink);
+        int child_partition = memory.memory.allocate(processes.size[running]);
+        if(child_partition == -1) {
+            memory.unlock(time);
+            sink.execution(time, 0, event_kind::FORK_PARTITION_ERROR);
+            return -1;
+        }
+
+        sink.partition_changed(time, child_partition, true);
+        int child = processes.add(child_pid, processes.PID[running], processes.program[running],
+                                  processes.size[running], child_partition);
+
+        sink.execution(time, duration, event_kind::CLONE_PCB);
+        time += duration;
+        memory.unlock(time);
+
+        sink.execution(time, 0, event_kind::SCHEDULER_CALLED);
+        time = kernel::iret(time, sink);
+
+        sink.system_status(time, trace_op::FORK, duration, processes, child, waiting());
+        return child;
+    }
+
+    //An EXEC of 'program' by 'running': loads it into a partition of its own (taken using
+    //best fit while the old one is still in use), frees the old one and reports the
+    //system status. Returns the image of the program, or nullptr if it is not an
+    //external file or no partition had room, in which case the process keeps what it had.
+    template<class partitions, class waiting_fn>
+    static const program_image* exec(int& time, int duration, int running, int program,
+                                     const simulation_context& context, partitions& memory,
+                                     process_table& processes, event_sink& sink, waiting_fn waiting) {
+        PROFILE_COUNT(EXECS, 1);
+        time = kernel::enter(time, EXEC_VECTOR, sink);
+
+        const program_image* image = context.programs.find(program);
+        const unsigned int exec_size = image ? image->size : 0;
+        if(exec_size == 0) {
+            sink.execution(time, 0, event_kind::EXEC_NOT_FOUND_ERROR);
+            return nullptr;
+        }
+
+        memory.lock(time, sink);
+        int partition_number = memory.memory.allocate(exec_size);
+        memory.unlock(time);
+        if(partition_number == -1) {
+            sink.execution(time, 0, event_kind::EXEC_PARTITION_ERROR);
+            return nullptr;
+        }
+
+        sink.execution(time, duration, event_kind::PROGRAM_SIZE, exec_size);
+        time += duration;
+
+        sink.execution(time, exec_size * costs::load_per_size, event_kind::LOAD_PROGRAM);
+        time += exec_size * costs::load_per_size;
+
+        sink.execution(time, costs::mark_partition, event_kind::MARK_PARTITION);
+        sink.partition_changed(time, partition_number, true);
+        time += costs::mark_partition;
+        memory.unlock(time);
+
+        sink.execution(time, costs::update_pcb, event_kind::UPDATE_PCB);
+        time += costs::update_pcb;
+
+        //the new partition is already marked
+        memory.release(time, processes.partition_number[running], sink);
+
+        sink.execution(time, 0, event_kind::SCHEDULER_CALLED);
+        time = kernel::iret(time, sink);
+
+        //the process now runs the new program, in the new partition
+        processes.program[running] = program;
+        processes.size[running] = exec_size;
+        processes.partition_number[running] = partition_number;
+
+        sink.system_status(time, trace_op::EXEC, duration, processes, running, waiting());
+        return image;
+    }
+};
+
+//The loop of simulate_trace and resume_trace: runs the process stack 'frames', 'steps'
+//instructions in, from 'time' until it is empty
+template<class costs>
+int run_process_stack(std::vector<process_frame>& frames, std::uint64_t steps, int time,
+                      const simulation_context& context, partition_manager& memory, process_table& processes,
+                      process_queue& wait_queue, event_sink& sink, exec_memo* memo, checkpointer* checkpoints,
+                      int coalesce_window) {
+
+    using work = kernel_work<costs>;
+
+    int current_time = time;
+    const bool details = sink.wants_details();
+    private_partitions partitions{memory};
+
+    const std::uint64_t first_step = steps;
+
+    while(!frames.empty()) {
+        process_frame& frame = frames.back();
+        instr_span code = frame.trace->block(frame.block); //!< instructions of the running process
+
+        if(frame.pc >= code.size()) {
+            //The process is done: release what it held and resume the one below it
+            if(frame.parent_waiting) {
+                wait_queue.pop();
+            }
+            if(frame.owns_process) {
+                processes.remove(frame.process);
+            }
+            partitions.release(current_time, frame.release_partition, sink);
+            if(memo && frame.recording != -1) {
+                memo->finish(frame.recording, current_time, memory, processes, frame.process);
+            }
+            frames.pop_back();
+            continue;
+        }
+
+        //a checkpoint goes between two instructions, once every finished process is gone
+        if(checkpoints && steps != first_step && checkpoints->due(steps)) {
+            simulation_checkpoint checkpoint = capture_checkpoint(frames, steps, current_time, context.symbols,
+                                                                  memory, processes, wait_queue);
+            checkpoints->save(checkpoint);
+        }
+
+        //run the next compiled instruction. Anything that pushes a process has to come
+        //last in its branch, as that invalidates 'frame'.
+        const trace_instr& instr = code[frame.pc++];
+        steps++;
+        const int running = frame.process;
+        int duration_intr = instr.operand;
+
+        if(instr.op == trace_op::CPU) { //As per Assignment 1
+            sink.execution(current_time, duration_intr, event_kind::CPU_BURST);
+            current_time += duration_intr;
+        } else if(instr.op == trace_op::SYSCALL) { //As per Assignment 1
+            work::syscall(current_time, duration_intr, context.delays, sink);
+        } else if(instr.op == trace_op::END_IO) {
+            work::end_io(current_time, duration_intr, code, frame.pc, coalesce_window, context.delays, sink);
+        } else if(instr.op == trace_op::FORK) {
+            // Next PID: one above every live process (the wait queue keeps its highest).
+            // The child is running in the system status: the parent waits first, then
+            // the wait_queue
+            unsigned int child_pid = std::max(processes.PID[running], wait_queue.max_pid()) + 1;
+            int child = work::fork(current_time, duration_intr, running, child_pid, partitions, processes, sink,
+                                   [&] { return waiting_view{running, wait_queue.entries()}; });
+
+            //The child's block and the index the parent resumes from were resolved
+            //when the trace was compiled (see split_fork_child)
+            const compiled_trace* parent_trace = frame.trace;
+            const fork_target& target = parent_trace->fork(instr.arg);
+            frame.pc = target.parent_index + 1;
+
+            ///////////////////////////////////////////////////////////////////////////////////////////
+            //With the child's trace, run the child: it goes on top of the parent, which
+            //resumes once the child is done and its partition has been freed
+
+            if(child != -1 && !parent_trace->block(target.child_block).empty()) {
+                // The parent waits for the child
+                wait_queue.push(running, processes.PID[running]);
+                
+                frames.push_back({parent_trace, target.child_block, 0, child, processes.partition_number[child],
+                                  true, true, -1, frame.program});
+                PROFILE_MAX(MAX_DEPTH, frames.size());
+            } else if(child != -1) {
+                // Nothing to run: the child is done as soon as it exists
+                processes.remove(child);
+            }
+
+            ///////////////////////////////////////////////////////////////////////////////////////////
+
+        } else if(instr.op == trace_op::EXEC) {
+            const int program = frame.trace->symbol(instr.arg);
+            if(details && memo) {
+                memo->exec_debug(current_time, program);
+            } else if(details) {
+                sink.exec_debug_line(context.symbols.name(program));
+            }
+
+            const program_image* image = work::exec(current_time, duration_intr, running, program, context,
+                                                    partitions, processes, sink,
+                                                    [&] { return waiting_view{-1, wait_queue.entries()}; });
+
+            //Nothing after an EXEC runs: the program replaces the process
+            frame.pc = code.size();
+
+            ///////////////////////////////////////////////////////////////////////////////////////////
+            //With the exec's trace (i.e. trace of external program), run the exec on top of
+            //the (now finished) process, which then releases what it held
+
+            if(image) {
+                // The exec'd program replaces the current process, which is never in its
+                // own wait queue (FORK hands out PIDs above every live one), so the queue
+                // is passed on as it is. The process keeps its slot; the frame of the
+                // program removes it.
+                bool owns_process = frame.owns_process;
+                frame.owns_process = false;
+
+                int recording = -1;
+                if(memo && memo->replay(current_time, memory, processes, running, wait_queue, recording)) {
+                    //the program ran from the cache, down to freeing its partition
+                    if(owns_process) {
+                        processes.remove(running);
+                    }
+                    continue;
+                }
+                frames.push_back({&context.programs.trace(*image), 0, 0, running, processes.partition_number[running],
+                                  false, owns_process, recording, program});
+                PROFILE_MAX(MAX_DEPTH, frames.size());
+            }
+
+            ///////////////////////////////////////////////////////////////////////////////////////////
+
+        }
+    }
+
+    return current_time;
+}
+
+//Runs a process and everything it forks or execs. The processes live on an explicit
+//stack: FORK and EXEC push the process to run next and the loop always runs the top
+//one, so nesting depth costs heap instead of native stack. Every process is a slot of
+//'processes'; 'current' is the one to run, and stays in the table when it finishes.
+//'wait_queue' holds the processes waiting on the running one; a FORK pushes the parent
+//for as long as its child runs. 'memory' is this simulation's own partition state.
+//'costs' is the kernel cost model (see standard_kernel_costs). With 'memo', which has to
+//be 'sink' as well, exec'd programs are replayed from it whenever it can; with
+//'checkpoints', checkpoints are taken on the way (see checkpointer). With a
+//'coalesce_window' of 0 or more, END_IOs of one device that follow each other share
+//an interrupt (see coalesce_end_ios). Returns the time at which the process finished.
+template<class costs = standard_kernel_costs>
+int simulate_trace(const compiled_trace& trace, int block, int time, const simulation_context& context, partition_manager& memory, process_table& processes, int current, process_queue& wait_queue, event_sink& sink, exec_memo* memo = nullptr, checkpointer* checkpoints = nullptr, int coalesce_window = -1) {
+    std::vector<process_frame> frames;
+    frames.push_back({&trace, block, 0, current, -1, false, false});
+    return run_process_stack<costs>(frames, 0, time, context, memory, processes, wait_queue, sink, memo,
+                                    checkpoints, coalesce_window);
+}
+
+//Goes on with simulate_trace from a checkpoint of 'trace' (see restore_checkpoint), as if
+//it had never stopped; 'processes' and 'wait_queue' start empty. Returns the time at
+//which the process finished, or -1 (and why in 'error') if the checkpoint does not fit.
+template<class costs = standard_kernel_costs>
+int resume_trace(const simulation_checkpoint& checkpoint, const compiled_trace& trace, const simulation_context& context,
+                 partition_manager& memory, process_table& processes, process_queue& wait_queue, event_sink& sink,
+                 std::string& error, exec_memo* memo = nullptr, checkpointer* checkpoints = nullptr,
+                 int coalesce_window = -1) {
+    std::vector<process_frame> frames;
+    if(!restore_checkpoint(checkpoint, trace, context, memory, processes, wait_queue, frames, error)) {
+        return -1;
+    }
+    return run_process_stack<costs>(frames, checkpoint.steps, checkpoint.time, context, memory, processes,
+                                    wait_queue, sink, memo, checkpoints, coalesce_window);
+}
+
+//A process of simulate_scheduled
+struct scheduled_process {
+    const compiled_trace*   trace = nullptr;
+    int                     block = 0;
+    size_t                  pc = 0;
+    int                     burst_left = 0;         //!< rest of a CPU burst cut short by the quantum
+    int                     process = -1;           //!< slot in the process table
+    int                     parent = -1;            //!< engine entry of the parent, -1 for none
+    int                     live_children = 0;
+    unsigned long           order = 0;              //!< creation order
+    int                     level = 0;              //!< feedback queue it is in (multilevel feedback only)
+    std::vector<int>        releases;               //!< partitions freed when it exits, the last first
+    bool                    owns_process = false;   //!< false for the process the caller passed in
+    bool                    finished = false;       //!< done with its trace, waiting on its children
+    int                     ready_since = 0;
+    int                     core = 0;               //!< run queue it is in (simulate_multicore only)
+    process_times           times;
+};
+
+/**
+ * \brief the live processes of simulate_scheduled and simulate_multicore
+ *
+ * Every process is an entry of 'engine' (entries of exited processes are reused) and
+ * a slot of the process table. A process done before its children waits for them to
+ * exit, and exits with the last of them.
+ */
+class process_pool {
+public:
+    explicit process_pool(std::pmr::memory_resource* arena): live(arena), live_pids(arena) {}
+
+    scheduled_process& operator[](int entry) {
+        return engine[entry];
+    }
+
+    //True once every process has exited
+    bool empty() const {
+        return live.empty();
+    }
+
+    size_t size() const {
+        return live.size();
+    }
+
+    //The PID of a new process: one above every live one, so they stay unique
+    unsigned int next_pid() const {
+        return *live_pids.rbegin() + 1;
+    }
+
+    //Starts a process at 'time' and returns its entry, for the caller to make ready.
+    //'parent' is the entry of its parent (-1 for none), 'partition_number' is freed
+    //when it exits.
+    int spawn(const compiled_trace* code, int code_block, int process, int parent, int partition_number,
+              bool owns_process, int time, const process_table& processes) {
+        int entry = engine.size();
+        if(free_entries.empty()) {
+            engine.emplace_back();
+        } else {
+            entry = free_entries.back();
+            free_entries.pop_back();
+        }
+
+        scheduled_process& proc = engine[entry];
+        proc.trace = code;
+        proc.block = code_block;
+        proc.pc = 0;
+        proc.burst_left = 0;
+        proc.process = process;
+        proc.parent = parent;
+        proc.live_children = 0;
+        proc.order = next_order++;
+        proc.level = 0;
+        proc.releases.assign(1, partition_number);
+        proc.owns_process = owns_process;
+        proc.finished = false;
+        proc.times = {time, -1, 0};
+
+        if(parent != -1) {
+            engine[parent].live_children++;
+        }
+        live.emplace(proc.order, entry);
+        live_pids.insert(processes.PID[process]);
+        return entry;
+    }
+
+    //The process is done with its trace: it exits now if it has no live children, and
+    //releases what it held; a parent that was only waiting on it exits too
+    template<class partitions>
+    void finish(int entry, int time, process_table& processes, partitions& memory, event_sink& sink) {
+        engine[entry].finished = true;
+        if(engine[entry].live_children != 0) {
+            return;
+        }
+
+        while(entry != -1) {
+            scheduled_process& proc = engine[entry];
+            sink.process_exited(time, processes, proc.process, proc.times);
+
+            live.erase(proc.order);
+            live_pids.erase(processes.PID[proc.process]);
+            if(proc.owns_process) {
+                processes.remove(proc.process);
+            }
+            for(auto it = proc.releases.rbegin(); it != proc.releases.rend(); ++it) {
+                memory.release(time, *it, sink);
+            }
+            free_entries.push_back(entry);
+
+            int parent = proc.parent;
+            entry = -1;
+            if(parent != -1 && --engine[parent].live_children == 0 && engine[parent].finished) {
+                entry = parent;
+            }
+        }
+    }
+
+    //Slots of every live process but 'running' and 'head', oldest first
+    const std::vector<int>& waiting_slots(int running, int head) {
+        waiting.clear();
+        for(const auto& [order, entry] : live) {
+            int slot = engine[entry].process;
+            if(slot != running && slot != head) {
+                waiting.push_back(slot);
+            }
+        }
+        return waiting;
+    }
+
+private:
+    std::vector<scheduled_process>      engine;
+    std::vector<int>                    free_entries;
+    std::pmr::map<unsigned long, int>   live;           //!< order -> entry of every live process
+    std::pmr::set<unsigned int>         live_pids;
+    unsigned long                       next_order = 0;
+    std::vector<int>                    waiting;
+};
+
+/**
+ * \brief decides which process of simulate_scheduled runs next
+ *
+ * It holds the ready processes, by engine entry; the running process is not one of
+ * them, and is handed back with ready() when it is preempted.
+ */
+class scheduler {
+public:
+    virtual ~scheduler() = default;
+
+    //'entry' can run: it was just created, its I/O completed or it was preempted
+    virtual void ready(int entry, const scheduled_process& process) = 0;
+
+    //Takes the process to run next out of the ready ones; -1 if none is ready
+    virtual int pick() = 0;
+
+    //The process pick() would take, left where it is; -1 if none is ready
+    virtual int next() const = 0;
+
+    //Takes the ready process it would run last, for another core to run instead (see
+    //simulate_multicore); -1 if none is ready. ready() puts it back where it was.
+    virtual int steal() = 0;
+
+    //Number of ready processes
+    virtual size_t size() const = 0;
+
+    //CPU time the process may use before it is preempted, 0 for as long as it wants
+    virtual int quantum(const scheduled_process& /*process*/) const { return 0; }
+
+    //The process used up its quantum; it is made ready again right after
+    virtual void expired(scheduled_process& /*process*/) {}
+
+    //True if a ready process should take the CPU from 'running' now
+    virtual bool preempts(const scheduled_process& /*running*/) const { return false; }
+};
+
+//First come, first served: a process keeps the CPU until it blocks or finishes
+class fcfs_scheduler : public scheduler {
+public:
+    explicit fcfs_scheduler(std::pmr::memory_resource* arena = std::pmr::get_default_resource()): queue(arena) {}
+
+    void ready(int entry, const scheduled_process& /*process*/) override {
+        queue.push_back(entry);
+    }
+
+    int pick() override {
+        if(queue.empty()) {
+            return -1;
+        }
+        int entry = queue.front();
+        queue.pop_front();
+        return entry;
+    }
+
+    int next() const override {
+        return queue.empty() ? -1 : queue.front();
+    }
+
+    int steal() override {
+        if(queue.empty()) {
+            return -1;
+        }
+        int entry = queue.back();
+        queue.pop_back();
+        return entry;
+    }
+
+    size_t size() const override {
+        return queue.size();
+    }
+
+protected:
+    std::pmr::deque<int> queue;
+};
+
+//FCFS that preempts a process once it has had 'slice' of CPU time in a row
+class round_robin_scheduler : public fcfs_scheduler {
+public:
+    explicit round_robin_scheduler(int slice, std::pmr::memory_resource* arena = std::pmr::get_default_resource()):
+        fcfs_scheduler(arena), slice(slice) {}
+
+    int quantum(const scheduled_process& /*process*/) const override {
+        return slice;
+    }
+
+private:
+    int slice;
+};
+
+//The most recently created ready process runs, taking the CPU from older ones; a FORK
+//child runs before its parent, as in simulate_trace
+class priority_scheduler : public scheduler {
+public:
+    explicit priority_scheduler(std::pmr::memory_resource* arena = std::pmr::get_default_resource()): queue(arena) {}
+
+    void ready(int entry, const scheduled_process& process) override {
+        queue.emplace(process.order, entry);
+    }
+
+    int pick() override {
+        if(queue.empty()) {
+            return -1;
+        }
+        auto newest = std::prev(queue.end());
+        int entry = newest->second;
+        queue.erase(newest);
+        return entry;
+    }
+
+    int next() const override {
+        return queue.empty() ? -1 : queue.rbegin()->second;
+    }
+
+    int steal() override {
+        if(queue.empty()) {
+            return -1;
+        }
+        int entry = queue.begin()->second;
+        queue.erase(queue.begin());
+        return entry;
+    }
+
+    size_t size() const override {
+        return queue.size();
+    }
+
+    bool preempts(const scheduled_process& running) const override {
+        return !queue.empty() && queue.rbegin()->first > running.order;
+    }
+
+private:
+    std::pmr::set<std::pair<unsigned long, int>> queue; //!< (order, entry)
+};
+
+//Round robin over a few queues: the quantum doubles with every level down, a process
+//that uses up its quantum drops a level, and a ready process in a higher level takes
+//the CPU. New processes start at the top.
+class feedback_scheduler : public scheduler {
+public:
+    static constexpr int levels = 3;
+
+    explicit feedback_scheduler(int slice, std::pmr::memory_resource* arena = std::pmr::get_default_resource()):
+        slice(slice), queues{std::pmr::deque<int>(arena), std::pmr::deque<int>(arena), std::pmr::deque<int>(arena)} {}
+
+    void ready(int entry, const scheduled_process& process) override {
+        queues[process.level].push_back(entry);
+    }
+
+    int pick() override {
+        for(auto& queue : queues) {
+            if(!queue.empty()) {
+                int entry = queue.front();
+                queue.pop_front();
+                return entry;
+            }
+        }
+        return -1;
+    }
+
+    int next() const override {
+        for(const auto& queue : queues) {
+            if(!queue.empty()) {
+                return queue.front();
+            }
+        }
+        return -1;
+    }
+
+    int steal() override {
+        for(auto queue = queues.rbegin(); queue != queues.rend(); ++queue) {
+            if(!queue->empty()) {
+                int entry = queue->back();
+                queue->pop_back();
+                return entry;
+            }
+        }
+        return -1;
+    }
+
+    size_t size() const override {
+        size_t ready = 0;
+        for(const auto& queue : queues) {
+            ready += queue.size();
+        }
+        return ready;
+    }
+
+    int quantum(const scheduled_process& process) const override {
+        return slice << process.level;
+    }
+
+    void expired(scheduled_process& process) override {
+        process.level = std::min(process.level + 1, levels - 1);
+    }
+
+    bool preempts(const scheduled_process& running) const override {
+        for(int level = 0; level < running.level; level++) {
+            if(!queues[level].empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    int                                 slice;
+    std::array<std::pmr::deque<int>, levels>    queues;
+};
+
+//The scheduler of a policy, its queues in 'arena'; RUN_TO_COMPLETION has none of its
+//own, and gets the priority scheduler, which keeps its order
+std::unique_ptr<scheduler> make_scheduler(scheduling_policy policy, int quantum,
+                                          std::pmr::memory_resource* arena = std::pmr::get_default_resource());
+
+/**
+ * \brief simulate_trace as a discrete-event engine, with a scheduler and optionally
+ * devices working alongside the CPU
+ *
+ * A FORK makes both the child and the parent ready, and 'policy' picks which process
+ * runs whenever the running one blocks, finishes, uses up its quantum (CPU bursts are
+ * cut there) or is preempted. A quantum running out is logged as the scheduler being
+ * called when another process gets the CPU.
+ *
+ * With 'overlap_io', a SYSCALL starts the I/O and blocks the process; the device
+ * completes 'delays' later (after whatever it still has queued), which is an event of
+ * a timer heap. Completions that are due interrupt between instructions and make their
+ * process ready again. With nothing ready the CPU idles until the next completion.
+ * Otherwise a SYSCALL holds the CPU for the whole I/O, as in simulate_trace.
+ *
+ * A process done before its children waits for them to exit. The priority scheduler
+ * gives the logs of simulate_trace as long as no process blocks.
+ *
+ * @param trace the compiled trace of the first process
+ * @param block the block of 'trace' it runs
+ * @param time the time it starts at
+ * @param context the tables of the simulation
+ * @param memory this simulation's own partition state
+ * @param processes the process table; 'current' stays in it when it finishes
+ * @param current slot of the first process
+ * @param policy decides which ready process runs
+ * @param overlap_io true for devices that work while the CPU runs other processes
+ * @param sink receives the logs, and the times of every process as it exits; every
+ *             live process but the running one is reported as waiting, oldest first
+ * @param coalesce_window -1, or how long after an interrupt is entered END_IOs (and
+ *                        completions) of its device still join it (see coalesce_end_ios)
+ * @return the time at which the last process finished
+ *
+ */
+template<class costs = standard_kernel_costs>
+int simulate_scheduled(const compiled_trace& trace, int block, int time, const simulation_context& context,
+                       partition_manager& memory, process_table& processes, int current,
+                       scheduler& policy, bool overlap_io, event_sink& sink, int coalesce_window = -1) {
+
+    using work = kernel_work<costs>;
+
+    int current_time = time;
+    const bool details = sink.wants_details();
+    private_partitions partitions{memory};
+
+    //the nodes of the sets come and go with the processes
+    simulation_arena arena;
+    process_pool pool(arena.resource());
+    io_timers timers;
+    std::vector<int> device_free(context.delays.size(), 0);    //!< when each device is done with its queue
+    unsigned long next_sequence = 0;
+    std::vector<int> completed;     //!< entries whose I/O one interrupt completed
+
+    int running_entry = -1;     //!< the process on the CPU, -1 for none
+    int preempted = -1;         //!< the process that last lost the CPU to the scheduler
+    int slice_left = 0;         //!< CPU time left of its quantum
+    bool sliced = false;        //!< false if it has no quantum
+
+    //Makes a process ready to run
+    auto make_ready = [&](int entry) {
+        pool[entry].ready_since = current_time;
+        policy.ready(entry, pool[entry]);
+    };
+
+    make_ready(pool.spawn(&trace, block, current, -1, -1, false, current_time, processes));
+
+    while(!pool.empty()) {
+        //Devices that are done interrupt between instructions
+        work::complete_io(current_time, timers, coalesce_window, completed, sink, make_ready);
+
+        //taking the CPU away after a FORK or an interrupt is part of what they log
+        if(running_entry != -1 && policy.preempts(pool[running_entry])) {
+            make_ready(running_entry);
+            running_entry = -1;
+        }
+
+        if(running_entry == -1) {
+            running_entry = policy.pick();
+            if(running_entry == -1) {
+                //every live process waits on a device, or on a child that does
+                const int next = timers.top().time;
+                sink.execution(current_time, next - current_time, event_kind::CPU_IDLE);
+                current_time = next;
+                continue;
+            }
+
+            scheduled_process& proc = pool[running_entry];
+            if(preempted != -1 && preempted != running_entry) {
+                sink.execution(current_time, 0, event_kind::SCHEDULER_CALLED);
+            }
+            preempted = -1;
+
+            proc.times.wait += current_time - proc.ready_since;
+            if(proc.times.first_run == -1) {
+                proc.times.first_run = current_time;
+            }
+            slice_left = policy.quantum(proc);
+            sliced = slice_left > 0;
+        }
+
+        const int entry = running_entry;
+        scheduled_process& proc = pool[entry];
+        instr_span code = proc.trace->block(proc.block);
+
+        if(proc.pc >= code.size()) {
+            running_entry = -1;
+            pool.finish(entry, current_time, processes, partitions, sink);
+            continue;
+        }
+
+        //run the next compiled instruction; spawning a process invalidates 'proc', so
+        //that comes last in its branch
+        const trace_instr& instr = code[proc.pc++];
+        const int running = proc.process;
+        int duration_intr = instr.operand;
+
+        if(instr.op == trace_op::CPU) {
+            int burst = proc.burst_left > 0 ? proc.burst_left : duration_intr;
+            if(sliced && burst > slice_left) {
+                //the rest of the burst runs the next time the process gets the CPU
+                proc.burst_left = burst - slice_left;
+                burst = slice_left;
+                proc.pc--;
+            } else {
+                proc.burst_left = 0;
+            }
+
+            sink.execution(current_time, burst, event_kind::CPU_BURST);
+            current_time += burst;
+
+            slice_left -= burst;
+            if(sliced && slice_left == 0) {
+                policy.expired(proc);
+                preempted = entry;
+                make_ready(entry);
+                running_entry = -1;
+            }
+        } else if(instr.op == trace_op::SYSCALL && overlap_io) {
+            const int done = work::start_io(current_time, duration_intr, context.delays, device_free, sink);
+            timers.push({done, next_sequence++, entry, duration_intr});
+            running_entry = -1;
+        } else if(instr.op == trace_op::SYSCALL) {
+            work::syscall(current_time, duration_intr, context.delays, sink);
+        } else if(instr.op == trace_op::END_IO) {
+            work::end_io(current_time, duration_intr, code, proc.pc, coalesce_window, context.delays, sink);
+        } else if(instr.op == trace_op::FORK) {
+            int child = work::fork(current_time, duration_intr, running, pool.next_pid(), partitions, processes, sink,
+                                   [&] { return waiting_view{running, pool.waiting_slots(running, running)}; });
+
+            const compiled_trace* parent_trace = proc.trace;
+            const fork_target& target = parent_trace->fork(instr.arg);
+            proc.pc = target.parent_index + 1;
+
+            //the scheduler decides whether the child takes the CPU from its parent
+            if(child != -1 && !parent_trace->block(target.child_block).empty()) {
+                make_ready(pool.spawn(parent_trace, target.child_block, child, entry,
+                                      processes.partition_number[child], true, current_time, processes));
+                PROFILE_MAX(MAX_DEPTH, pool.size());
+            } else if(child != -1) {
+                processes.remove(child);
+            }
+        } else if(instr.op == trace_op::EXEC) {
+            const int program = proc.trace->symbol(instr.arg);
+            if(details) {
+                sink.exec_debug_line(context.symbols.name(program));
+            }
+
+            const program_image* image = work::exec(current_time, duration_intr, running, program, context,
+                                                    partitions, processes, sink,
+                                                    [&] { return waiting_view{-1, pool.waiting_slots(running, -1)}; });
+
+            if(image) {
+                //the process runs the program from here on, and frees both partitions
+                //when it exits, the program's first
+                proc.trace = &context.programs.trace(*image);
+                proc.block = 0;
+                proc.pc = 0;
+                proc.releases.push_back(processes.partition_number[running]);
+            } else {
+                proc.pc = code.size();
+            }
+        }
+    }
+
+    return current_time;
+}
+
+//A core of simulate_multicore: its clock, its run queue and the process it runs
+struct processor_core {
+    int                         time = 0;
+    std::unique_ptr<scheduler>  queue;
+    int                         running = -1;       //!< engine entry, -1 for none
+    int                         preempted = -1;     //!< the process that last lost it to the scheduler
+    int                         slice_left = 0;
+    bool                        sliced = false;
+    bool                        parked = false;     //!< nothing to run; waits for 'wake' or its devices
+    int                         wake = INT_MAX;     //!< when a process became ready it may steal
+    std::priority_queue<io_completion, std::vector<io_completion>, std::greater<io_completion>> timers;
+};
+
+/**
+ * \brief simulate_scheduled on several cores, each with a run queue of its own
+ *
+ * Every core has its own clock and its own scheduler of 'policy'. The core with the
+ * earliest clock runs next, one instruction (or interrupt) at a time, so the lines of
+ * a core are in time order and those of different cores interleave by the time each
+ * step started; sink.core_changed() tells which core the lines that follow ran on.
+ *
+ * A FORK child goes to the run queue of the core with the fewest processes, its
+ * parent's on a tie. No core runs a process before the time it became ready, which
+ * the clock of the core that made it ready can be ahead of. A core with nothing to run
+ * steals from the core with the most ready processes (the one that would run there
+ * last); otherwise it idles until a process becomes ready somewhere or one of its
+ * devices completes. I/O completes on the core that started it.
+ *
+ * The partition table is shared: a FORK holds it from its allocation until the PCB is
+ * cloned, an EXEC until the partition is marked, and a partition is freed once no
+ * other core holds it. A core that needs it while another holds it logs MEMORY_WAIT.
+ * On one core this is simulate_scheduled, down to the times.
+ *
+ * @param trace the compiled trace of the first process
+ * @param block the block of 'trace' it runs
+ * @param time the time it starts at, on every core
+ * @param context the tables of the simulation
+ * @param memory this simulation's own partition state
+ * @param processes the process table; 'current' stays in it when it finishes
+ * @param current slot of the first process, which starts on core 0
+ * @param policy the scheduler of every core
+ * @param quantum the time slice of the policies that have one
+ * @param core_count number of cores
+ * @param overlap_io true for devices that work while the CPU runs other processes
+ * @param sink receives the logs; every live process but the running one is reported
+ *             as waiting, oldest first, whichever core it is on
+ * @param coalesce_window as in simulate_scheduled
+ * @return the time at which the last process finished
+ *
+ */
+template<class costs = standard_kernel_costs>
+int simulate_multicore(const compiled_trace& trace, int block, int time, const simulation_context& context,
+                       partition_manager& memory, process_table& processes, int current,
+                       scheduling_policy policy, int quantum, int core_count, bool overlap_io, event_sink& sink,
+                       int coalesce_window = -1) {
+
+    using work = kernel_work<costs>;
+
+    int current_time = time;    //!< clock of the core taking a step
+    const bool details = sink.wants_details();
+    shared_partitions partitions{memory, time};
+
+    simulation_arena arena;
+    std::vector<processor_core> cores(core_count);
+    for(auto& core : cores) {
+        core.time = time;
+        core.queue = make_scheduler(policy, quantum, arena.resource());
+    }
+    int shown_core = -1;
+
+    process_pool pool(arena.resource());
+    std::vector<int> device_free(context.delays.size(), 0);    //!< when each device is done with its queue
+    unsigned long next_sequence = 0;
+    std::vector<int> completed;     //!< entries whose I/O one interrupt completed
+
+    //Makes a process ready to run on 'core'. If that core is busy, one idle core (one
+    //not woken up yet, if there is one) wakes up to steal it.
+    auto make_ready = [&](int entry, int core) {
+        pool[entry].ready_since = current_time;
+        pool[entry].core = core;
+        cores[core].queue->ready(entry, pool[entry]);
+
+        processor_core* idle = cores[core].parked ? &cores[core] : nullptr;
+        for(auto& other : cores) {
+            if(idle == nullptr && other.parked) {
+                idle = &other;
+            } else if(idle != nullptr && idle->wake != INT_MAX && other.parked && other.wake == INT_MAX) {
+                idle = &other;
+            }
+            if(idle != nullptr && idle->wake == INT_MAX) {
+                break;
+            }
+        }
+        if(idle != nullptr) {
+            idle->wake = std::min(idle->wake, current_time);
+        }
+    };
+
+    //The core a new process goes to: the one with the fewest processes, 'preferred' on a tie
+    auto place = [&](int preferred) {
+        auto load = [&](int core) { return cores[core].queue->size() + (cores[core].running != -1); };
+        int best = preferred;
+        for(int core = 0; core < core_count; core++) {
+            if(load(core) < load(best)) {
+                best = core;
+            }
+        }
+        return best;
+    };
+
+    //A ready process of another core for 'self' to run; -1 (and a time to look again
+    //at in 'self.wake') if there is none it can have yet
+    auto steal = [&](int self) {
+        int victim = -1;
+        for(int core = 0; core < core_count; core++) {
+            if(core != self && cores[core].queue->size() > 0
+               && (victim == -1 || cores[core].queue->size() > cores[victim].queue->size())) {
+                victim = core;
+            }
+        }
+        if(victim == -1) {
+            return -1;
+        }
+
+        int entry = cores[victim].queue->steal();
+        if(pool[entry].ready_since > current_time) {
+            cores[victim].queue->ready(entry, pool[entry]);
+            cores[self].wake = std::min(cores[self].wake, pool[entry].ready_since);
+            return -1;
+        }
+        pool[entry].core = self;
+        return entry;
+    };
+
+    //Runs one instruction (or the interrupts that are due) on core 'self'
+    auto step = [&](int self) {
+        processor_core& core = cores[self];
+
+        //Devices that are done interrupt between instructions
+        work::complete_io(current_time, core.timers, coalesce_window, completed, sink,
+                          [&](int entry) { make_ready(entry, self); });
+
+        //Another core can make a process ready at a time this one has not got to yet;
+        //until it has, the process is not there to run or to preempt with
+        const int next = core.queue->next();
+        const bool next_ready = next != -1 && pool[next].ready_since <= current_time;
+
+        //taking the CPU away after a FORK or an interrupt is part of what they log
+        if(core.running != -1 && next_ready && core.queue->preempts(pool[core.running])) {
+            make_ready(core.running, self);
+            core.running = -1;
+        }
+
+        if(core.running == -1) {
+            if(next_ready) {
+                core.running = core.queue->pick();
+            } else {
+                core.running = steal(self);
+            }
+            if(core.running == -1) {
+                //nothing this core can run before it wakes up again
+                if(next != -1) {
+                    core.wake = std::min(core.wake, pool[next].ready_since);
+                }
+                core.parked = true;
+                return;
+            }
+
+            scheduled_process& proc = pool[core.running];
+            if(core.preempted != -1 && core.preempted != core.running) {
+                sink.execution(current_time, 0, event_kind::SCHEDULER_CALLED);
+            }
+            core.preempted = -1;
+
+            proc.times.wait += current_time - proc.ready_since;
+            if(proc.times.first_run == -1) {
+                proc.times.first_run = current_time;
+            }
+            core.slice_left = core.queue->quantum(proc);
+            core.sliced = core.slice_left > 0;
+        }
+
+        const int entry = core.running;
+        scheduled_process& proc = pool[entry];
+        instr_span code = proc.trace->block(proc.block);
+
+        if(proc.pc >= code.size()) {
+            core.running = -1;
+            pool.finish(entry, current_time, processes, partitions, sink);
+            return;
+        }
+
+        //run the next compiled instruction; spawning a process invalidates 'proc', so
+        //that comes last in its branch
+        const trace_instr& instr = code[proc.pc++];
+        const int running = proc.process;
+        int duration_intr = instr.operand;
+
+        if(instr.op == trace_op::CPU) {
+            int burst = proc.burst_left > 0 ? proc.burst_left : duration_intr;
+            if(core.sliced && burst > core.slice_left) {
+                //the rest of the burst runs the next time the process gets the CPU
+                proc.burst_left = burst - core.slice_left;
+                burst = core.slice_left;
+                proc.pc--;
+            } else {
+                proc.burst_left = 0;
+            }
+
+            sink.execution(current_time, burst, event_kind::CPU_BURST);
+            current_time += burst;
+
+            core.slice_left -= burst;
+            if(core.sliced && core.slice_left == 0) {
+                core.queue->expired(proc);
+                core.preempted = entry;
+                make_ready(entry, self);
+                core.running = -1;
+            }
+        } else if(instr.op == trace_op::SYSCALL && overlap_io) {
+            //the device takes one request at a time, from whichever core
+            const int done = work::start_io(current_time, duration_intr, context.delays, device_free, sink);
+            core.timers.push({done, next_sequence++, entry, duration_intr});
+            core.running = -1;
+        } else if(instr.op == trace_op::SYSCALL) {
+            work::syscall(current_time, duration_intr, context.delays, sink);
+        } else if(instr.op == trace_op::END_IO) {
+            work::end_io(current_time, duration_intr, code, proc.pc, coalesce_window, context.delays, sink);
+        } else if(instr.op == trace_op::FORK) {
+            int child = work::fork(current_time, duration_intr, running, pool.next_pid(), partitions, processes, sink,
+                                   [&] { return waiting_view{running, pool.waiting_slots(running, running)}; });
+
+            const compiled_trace* parent_trace = proc.trace;
+            const fork_target& target = parent_trace->fork(instr.arg);
+            proc.pc = target.parent_index + 1;
+
+            //the child may go to another core; the scheduler of its core decides
+            //whether it takes the CPU from what runs there
+            if(child != -1 && !parent_trace->block(target.child_block).empty()) {
+                make_ready(pool.spawn(parent_trace, target.child_block, child, entry,
+                                      processes.partition_number[child], true, current_time, processes),
+                           place(self));
+                PROFILE_MAX(MAX_DEPTH, pool.size());
+            } else if(child != -1) {
+                processes.remove(child);
+            }
+        } else if(instr.op == trace_op::EXEC) {
+            const int program = proc.trace->symbol(instr.arg);
+            if(details) {
+                sink.exec_debug_line(context.symbols.name(program));
+            }
+
+            const program_image* image = work::exec(current_time, duration_intr, running, program, context,
+                                                    partitions, processes, sink,
+                                                    [&] { return waiting_view{-1, pool.waiting_slots(running, -1)}; });
+
+            if(image) {
+                //the process runs the program from here on, and frees both partitions
+                //when it exits, the program's first
+                proc.trace = &context.programs.trace(*image);
+                proc.block = 0;
+                proc.pc = 0;
+                proc.releases.push_back(processes.partition_number[running]);
+            } else {
+                proc.pc = code.size();
+            }
+        }
+    };
+
+    current_time = time;
+    make_ready(pool.spawn(&trace, block, current, -1, -1, false, current_time, processes), 0);
+
+    int end_time = time;
+    while(!pool.empty()) {
+        //the core whose next step comes first; a parked one steps once it wakes up or
+        //one of its devices completes
+        int self = -1;
+        int next = INT_MAX;
+        for(int c = 0; c < core_count; c++) {
+            const processor_core& core = cores[c];
+            int at = core.time;
+            if(core.parked) {
+                at = std::min(core.wake, core.timers.empty() ? INT_MAX : core.timers.top().time);
+                at = std::max(at, core.time);
+            }
+            if(at < next) {
+                next = at;
+                self = c;
+            }
+        }
+        if(self == -1) {
+            break;  //every live process waits on something that never comes
+        }
+
+        processor_core& core = cores[self];
+        if(self != shown_core) {
+            sink.core_changed(self);
+            shown_core = self;
+        }
+        if(core.parked) {
+            if(next > core.time) {
+                sink.execution(core.time, next - core.time, event_kind::CPU_IDLE);
+            }
+            core.time = next;
+            core.parked = false;
+            core.wake = INT_MAX;
+        }
+
+        current_time = core.time;
+        step(self);
+        core.time = current_time;
+        end_time = std::max(end_time, current_time);
+    }
+
+    return end_time;
+}
+
+//Partitions memory, loads the init process and runs the trace, reporting to 'sink'. With
+//'resume' the run to completion engine goes on from that checkpoint instead, and with
+//'checkpoints' it takes them on the way. Returns false, with why in 'error', if init
+//has no partition, the checkpoint does not fit or a checkpoint could not be written.
+bool simulate(const compiled_trace& trace, const simulation_context& context,
+              const simulation_options& options, event_sink& sink, std::string& error,
+              checkpointer* checkpoints = nullptr, const simulation_checkpoint* resume = nullptr);
+
+//One line of the execution log, as callback_sink and event_ring hand it out
+struct simulation_event {
+    int         time;
+    int         duration;
+    int         operand;    //!< what the line is about: device, size, ... (see event_sink::execution)
+    int         core;       //!< 0 unless simulate_multicore runs it
+    event_kind  kind;
+};
+
+/**
+ * \brief an event_sink made of callbacks
+ *
+ * Each line of the execution log reaches 'on_execution' while the simulation runs,
+ * as a simulation_event that only lives for the call. 'on_status' gets the system
+ * status tables the way event_sink::system_status does, with the live process table
+ * instead of a copy; without it they are dropped, and the sink asks for no details.
+ * Nothing is printed, the EXEC debug lines included.
+ */
+class callback_sink : public event_sink {
+public:
+    using execution_callback = std::function<void(const simulation_event& event)>;
+    using status_callback = std::function<void(int time, trace_op trace, int duration, const process_table& processes,
+                                               int running, waiting_view waiting)>;
+
+    explicit callback_sink(execution_callback on_execution, status_callback on_status = nullptr):
+        on_execution(std::move(on_execution)), on_status(std::move(on_status)) {}
+
+    void execution(int time, int duration, event_kind kind, int operand) override {
+        on_execution({time, duration, operand, core, kind});
+    }
+
+    void system_status(int time, trace_op trace, int duration, const process_table& processes,
+                       int running, waiting_view waiting) override {
+        //the engines report the tables to every sink, details or not
+        if(on_status) {
+            on_status(time, trace, duration, processes, running, waiting);
+        }
+    }
+
+    void core_changed(int next_core) override {
+        core = next_core;
+    }
+
+    void exec_debug_line(const std::string& /*program_name*/) override {}
+
+    bool wants_details() const override {
+        return (bool)on_status;
+    }
+
+private:
+    execution_callback  on_execution;
+    status_callback     on_status;
+    int                 core = 0;
+};
+
+/**
+ * \brief a bounded queue of events from the thread running a simulation to one reading them
+ *
+ * One thread pushes (see ring_sink), one consumes; neither takes a lock. The slots are
+ * handed to the consumer in place, so an event is copied once, into the ring. A full
+ * ring holds the simulation back until the consumer catches up, so the consumer sets
+ * the pace and memory stays at 'capacity' events however long the run is.
+ */
+class event_ring {
+public:
+    //'capacity' is rounded up to a power of two
+    explicit event_ring(size_t capacity = 1 << 16) {
+        size_t size = 1;
+        while(size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    event_ring(const event_ring&) = delete;
+    event_ring& operator=(const event_ring&) = delete;
+
+    //Producer: adds an event, waiting while the ring is full
+    void push(const simulation_event& event) {
+        const size_t head = write_index.load(std::memory_order_relaxed);
+        while(head - cached_read == slots.size()) {
+            cached_read = read_index.load(std::memory_order_acquire);
+            if(head - cached_read == slots.size()) {
+                std::this_thread::yield();
+            }
+        }
+        slots[head & mask] = event;
+        write_index.store(head + 1, std::memory_order_release);
+    }
+
+    //Producer: no more events will come
+    void close() {
+        closed.store(true, std::memory_order_release);
+    }
+
+    /**
+     * \brief passes up to 'max' events to 'on_event', oldest first, waiting for one if there are none
+     *
+     * @param on_event called as on_event(const simulation_event&) with the slot itself,
+     *                 which is handed back to the producer once consume returns
+     * @param max the most events to take at once
+     * @return how many events were passed on; 0 only once the ring is closed and empty
+     *
+     */
+    template<class callback>
+    size_t consume(callback&& on_event, size_t max = SIZE_MAX) {
+        const size_t tail = read_index.load(std::memory_order_relaxed);
+        size_t head = write_index.load(std::memory_order_acquire);
+        while(head == tail) {
+            if(closed.load(std::memory_order_acquire)) {
+                //whatever was pushed before the ring closed is visible by now
+                head = write_index.load(std::memory_order_acquire);
+                if(head == tail) {
+                    return 0;
+                }
+                break;
+            }
+            std::this_thread::yield();
+            head = write_index.load(std::memory_order_acquire);
+        }
+
+        const size_t count = std::min(head - tail, max);
+        for(size_t i = 0; i < count; i++) {
+            const simulation_event& event = slots[(tail + i) & mask];
+            on_event(event);
+        }
+        read_index.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    std::vector<simulation_event>   slots;
+    size_t                          mask = 0;
+
+    alignas(64) std::atomic<size_t> write_index{0};
+    size_t                          cached_read = 0;    //!< producer's last look at read_index
+    alignas(64) std::atomic<size_t> read_index{0};
+    std::atomic<bool>               closed{false};
+};
+
+//Pushes every line of the execution log into an event_ring. The system status tables
+//are dropped, and it asks for no details, so there are no EXEC debug lines either.
+class ring_sink : public event_sink {
+public:
+    explicit ring_sink(event_ring& ring): ring(ring) {}
+
+    void execution(int time, int duration, event_kind kind, int operand) override {
+        ring.push({time, duration, operand, core, kind});
+    }
+
+    void system_status(int /*time*/, trace_op /*trace*/, int /*duration*/, const process_table& /*processes*/,
+                       int /*running*/, waiting_view /*waiting*/) override {}
+
+    void core_changed(int next_core) override {
+        core = next_core;
+    }
+
+    bool wants_details() const override {
+        return false;
+    }
+
+private:
+    event_ring& ring;
+    int         core = 0;
+};
+
+/**
+ * \brief the simulator as a library: tables from memory, events to a sink as they happen
+ *
+ * Holds what a table_cache holds for the command line (the vector, device and
+ * partition tables, the external programs and the symbols of their names) without
+ * reading a file. Traces come in as lines or as binary trace files; either way they
+ * are bound to the simulator's symbols first. Nothing here prints or exits the
+ * process: a bad trace, or a run that cannot go on, makes the call return false with
+ * what is wrong in 'error'.
+ *
+ * Adding programs and compiling or binding traces add symbols, so they all come
+ * before the first run; from then on run() only reads the simulator, and any number
+ * of runs can go on at once on different threads, each with its own sink.
+ *
+ *     simulator sim(vectors, delays);
+ *     compiled_trace trace;
+ *     std::string error;
+ *     if(!sim.add_program("program1", 10, program_lines, error) || !sim.compile(trace_lines, trace, error)) {
+ *         ... report 'error' ...
+ *     }
+ *
+ *     event_ring ring;
+ *     std::thread producer([&] { sim.stream(trace, simulation_options(), ring); });
+ *     while(ring.consume([&](const simulation_event& event) { ... }) > 0) {}
+ *     producer.join();
+ */
+class simulator {
+public:
+    simulator(std::vector<std::string> vectors, std::vector<int> delays,
+              std::vector<memory_partition_t> partitions = default_partitions()):
+        vectors(std::move(vectors)), delays(std::move(delays)), partitions(std::move(partitions)) {}
+
+    //Adds a program EXEC can run, from the lines of its trace; false if a line is
+    //malformed or raises an interrupt the tables do not have, or the name is taken
+    bool add_program(const std::string& name, unsigned int size, const std::vector<std::string>& lines,
+                     std::string& error) {
+        compiled_trace program;
+        if(!compile_trace(lines, program, error)) {
+            error = "Program " + name + ": " + error;
+            return false;
+        }
+        return add_program(name, size, std::move(program), error);
+    }
+
+    //Adds a program EXEC can run, already compiled; false if a line raises an interrupt
+    //the tables do not have, or the name is taken
+    bool add_program(const std::string& name, unsigned int size, compiled_trace program, std::string& error) {
+        if(!check_devices(program, vectors, delays, error)) {
+            error = "Program " + name + ": " + error;
+            return false;
+        }
+        int symbol = symbols.intern(name);
+        if(programs.find(symbol) != nullptr) {
+            error = "Program " + name + " was added already";
+            return false;
+        }
+        program.bind(symbols);
+        programs.add(symbol, size, std::move(program));
+        external_files.push_back({name, size});
+        return true;
+    }
+
+    //Compiles the lines of a trace and binds it, ready to run; false if a line is
+    //malformed or raises an interrupt the tables do not have
+    bool compile(const std::vector<std::string>& lines, compiled_trace& trace, std::string& error) {
+        if(!compile_trace(lines, trace, error) || !check_devices(trace, vectors, delays, error)) {
+            return false;
+        }
+        trace.bind(symbols);
+        return true;
+    }
+
+    //Maps a binary trace (see write_binary_trace) and binds it, ready to run; false if
+    //the file cannot be read, is not a valid binary trace or raises an interrupt the
+    //tables do not have
+    bool load(const std::string& filename, compiled_trace& trace, std::string& error) {
+        if(!read_binary_trace(filename, trace, error) || !check_devices(trace, vectors, delays, error)) {
+            return false;
+        }
+        trace.bind(symbols);
+        return true;
+    }
+
+    //Binds a trace compiled elsewhere, ready to run
+    void bind(compiled_trace& trace) {
+        trace.bind(symbols);
+    }
+
+    //Runs a bound trace, 'sink' getting each event as it happens; false if it cannot
+    //run (see simulate)
+    bool run(const compiled_trace& trace, const simulation_options& options, event_sink& sink,
+             std::string& error) const {
+        return simulate(trace, context(), options, sink, error);
+    }
+
+    //Runs a bound trace into 'ring' and closes it, whether it ran or not; call it on the
+    //thread that produces
+    bool stream(const compiled_trace& trace, const simulation_options& options, event_ring& ring,
+                std::string& error) const {
+        ring_sink sink(ring);
+        bool ran = run(trace, options, sink, error);
+        ring.close();
+        return ran;
+    }
+
+    //The tables, as the engines take them
+    simulation_context context() const {
+        return {vectors, delays, external_files, programs, partitions, symbols};
+    }
+
+private:
+    std::vector<std::string>        vectors;
+    std::vector<int>                delays;
+    std::vector<memory_partition_t> partitions;
+    std::vector<external_file>      external_files;
+    symbol_table                    symbols;
+    program_registry                programs;
+};
 
-}
 #endif
-// Helper function to append system status table
-void append_system_status(std::string& system_status, int current_time, const std::string& trace_type, 
-                         int duration, const PCB& running_pcb, const std::vector<PCB>& waiting_pcbs) {
-    system_status += "time: " + std::to_string(current_time) + "; current trace: " + trace_type + ", " 
-                    + std::to_string(duration) + "\n";
-    system_status += "+------------------------------------------------------+\n";
-    system_status += "| PID |program name |partition number | size |   state |\n";
-    system_status += "+------------------------------------------------------+\n";
-    
-    // Show running process
-    system_status += "|   " + std::to_string(running_pcb.PID) + " |    " + running_pcb.program_name 
-            + " |               " + std::to_string(running_pcb.partition_number) + " |    " 
-            + std::to_string(running_pcb.size) + " | running |\n";
-    
-    // Show all waiting processes
-    for (const auto& pcb : waiting_pcbs) {
-        system_status += "|   " + std::to_string(pcb.PID) + " |    " + pcb.program_name 
-                + " |               " + std::to_string(pcb.partition_number) + " |    " 
-                + std::to_string(pcb.size) + " | waiting |\n";
-    }
-    
-    system_status += "+------------------------------------------------------+\n\n";
-}
\ No newline at end of file
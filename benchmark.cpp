@@ -0,0 +1,337 @@
+/**
+ *
+ * @file benchmark.cpp
+ * @brief throughput benchmark for simulate_trace, with a synthetic trace generator
+ *
+ * Generates a trace (and the external programs it execs) from a handful of
+ * parameters, runs it through simulate_trace a few times and reports events per
+ * second, log bytes per second and peak RSS. With --emit the generated files are
+ * also written out, so the same workload can be run through the simulator itself.
+ *
+ */
+
+#include "Interrupts_101166589_101257741.hpp"
+#include <chrono>
+#include <sys/resource.h>
+
+//What to generate and how to run it
+struct benchmark_options {
+    size_t          lines           = 1000000;  //!< activities in the top level trace
+    unsigned int    seed            = 1;
+    unsigned int    fork_depth      = 3;        //!< levels of programs a FORK child can exec
+    unsigned int    exec_fanout     = 4;        //!< programs per level
+    size_t          program_lines   = 16;       //!< activities per external program
+    unsigned int    devices         = 20;
+    unsigned int    partitions      = 1024;
+    unsigned int    repeat          = 3;
+    double          cpu             = 0.50;     //!< weights of each activity in the mix
+    double          syscall         = 0.20;
+    double          end_io          = 0.25;
+    double          fork            = 0.05;
+    std::string     emit_dir;                   //!< where to write the generated files, if anywhere
+    std::string     log_prefix;                 //!< where to write the logs (default: /dev/null)
+};
+
+//A generated workload: the trace, the programs it can exec and the tables
+struct generated_workload {
+    std::vector<std::string>                trace;
+    std::vector<external_file>              external_files;
+    std::vector<std::vector<std::string>>   programs;       //!< trace of each external file
+    std::vector<std::string>                vectors;
+    std::vector<int>                        delays;
+    std::vector<memory_partition_t>         partitions;
+};
+
+std::string program_name(unsigned int level, unsigned int index) {
+    return "bench_" + std::to_string(level) + "_" + std::to_string(index);
+}
+
+//Appends 'count' activities. A FORK becomes a whole FORK/IF_CHILD/EXEC/IF_PARENT/ENDIF
+//group whose child execs a program of the next level; at the last level it is a CPU burst.
+void generate_body(std::vector<std::string>& out, size_t count, unsigned int level,
+                   const benchmark_options& options, std::mt19937& rng) {
+    std::discrete_distribution<int> mix({options.cpu, options.syscall, options.end_io, options.fork});
+    std::uniform_int_distribution<int> burst(1, 100);
+    std::uniform_int_distribution<unsigned int> device(0, options.devices - 1);
+    std::uniform_int_distribution<unsigned int> program(0, options.exec_fanout - 1);
+
+    for(size_t i = 0; i < count; i++) {
+        int activity = mix(rng);
+        if(activity == 3 && level >= options.fork_depth) {
+            activity = 0;
+        }
+
+        switch(activity) {
+            case 0:
+                out.push_back("CPU, " + std::to_string(burst(rng)));
+                break;
+            case 1:
+                out.push_back("SYSCALL, " + std::to_string(device(rng)));
+                break;
+            case 2:
+                out.push_back("END_IO, " + std::to_string(device(rng)));
+                break;
+            default:
+                out.push_back("FORK, " + std::to_string(burst(rng) % 20 + 1));
+                out.push_back("IF_CHILD, 0");
+                out.push_back("CPU, " + std::to_string(burst(rng)));
+                out.push_back("EXEC " + program_name(level + 1, program(rng)) + ", " + std::to_string(burst(rng) % 50 + 1));
+                out.push_back("IF_PARENT, 0");
+                out.push_back("CPU, " + std::to_string(burst(rng)));
+                out.push_back("ENDIF, 0");
+                break;
+        }
+    }
+}
+
+generated_workload generate_workload(const benchmark_options& options) {
+    generated_workload workload;
+    std::mt19937 rng(options.seed);
+
+    generate_body(workload.trace, options.lines, 0, options, rng);
+
+    std::uniform_int_distribution<unsigned int> program_size(1, 16);
+    for(unsigned int level = 1; level <= options.fork_depth; level++) {
+        for(unsigned int index = 0; index < options.exec_fanout; index++) {
+            workload.external_files.push_back({program_name(level, index), program_size(rng)});
+            workload.programs.emplace_back();
+            generate_body(workload.programs.back(), options.program_lines, level, options, rng);
+        }
+    }
+
+    std::uniform_int_distribution<int> delay(50, 1000);
+    for(unsigned int i = 0; i < options.devices; i++) {
+        char address[16];
+        snprintf(address, sizeof(address), "0X%04X", (unsigned int)(rng() & 0xFFFF));
+        workload.vectors.push_back(address);
+        workload.delays.push_back(delay(rng));
+    }
+
+    std::uniform_int_distribution<unsigned int> partition_size(1, 64);
+    for(unsigned int i = 0; i < options.partitions; i++) {
+        workload.partitions.emplace_back(i + 1, partition_size(rng));
+    }
+
+    return workload;
+}
+
+void write_lines(const std::string& filename, const std::vector<std::string>& lines) {
+    std::ofstream output_file(filename);
+    if(!output_file.is_open()) {
+        std::cerr << "Error: Unable to write file: " << filename << std::endl;
+        exit(1);
+    }
+    for(const auto& line : lines) {
+        output_file << line << '\n';
+    }
+}
+
+//Writes the workload in the simulator's input formats; run it from inside 'dir' as
+//./interrupts trace.txt vector_table.txt device_table.txt external_files.txt partition_table.txt
+void emit_workload(const generated_workload& workload, const std::string& dir) {
+    write_lines(dir + "/trace.txt", workload.trace);
+    write_lines(dir + "/vector_table.txt", workload.vectors);
+
+    std::vector<std::string> lines;
+    for(int delay : workload.delays) {
+        lines.push_back(std::to_string(delay));
+    }
+    write_lines(dir + "/device_table.txt", lines);
+
+    lines.clear();
+    for(size_t i = 0; i < workload.external_files.size(); i++) {
+        const auto& file = workload.external_files[i];
+        lines.push_back(file.program_name + "," + std::to_string(file.size));
+        write_lines(dir + "/" + file.program_name + ".txt", workload.programs[i]);
+    }
+    write_lines(dir + "/external_files.txt", lines);
+
+    lines.clear();
+    for(const auto& partition : workload.partitions) {
+        lines.push_back(std::to_string(partition.size));
+    }
+    write_lines(dir + "/partition_table.txt", lines);
+}
+
+//Forwards to another sink, counting what goes through
+class counting_sink : public event_sink {
+public:
+    explicit counting_sink(event_sink& next): next(next) {}
+
+    void execution(int time, int duration, event_kind kind, int operand) override {
+        executions++;
+        next.execution(time, duration, kind, operand);
+    }
+
+    void system_status(int time, trace_op trace, int duration, const process_table& processes,
+                       int running, waiting_view waiting) override {
+        snapshots++;
+        next.system_status(time, trace, duration, processes, running, waiting);
+    }
+
+    size_t executions = 0;
+    size_t snapshots = 0;
+
+private:
+    event_sink& next;
+};
+
+//Resets the peak RSS so what follows is measured on its own (Linux only; elsewhere the
+//peak stays the one of the whole process)
+void reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    if(clear_refs.is_open()) {
+        clear_refs << "5";
+    }
+}
+
+//Peak resident set size in KiB
+long peak_rss_kb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stol(line.substr(6));
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void usage() {
+    std::cout << "Usage: ./benchmark [--lines N] [--seed N] [--fork-depth N] [--exec-fanout N]\n"
+                 "                   [--program-lines N] [--devices N] [--partitions N] [--repeat N]\n"
+                 "                   [--mix CPU,SYSCALL,END_IO,FORK] [--emit DIR] [--log PREFIX]" << std::endl;
+    exit(1);
+}
+
+benchmark_options parse_benchmark_args(int argc, char** argv) {
+    benchmark_options options;
+
+    for(int i = 1; i < argc; i++) {
+        std::string_view flag = argv[i];
+        if(i + 1 >= argc) {
+            usage();
+        }
+        std::string_view value = argv[++i];
+
+        int number = 0;
+        bool numeric = parse_int(value, number) && number >= 0;
+
+        if(flag == "--lines" && numeric) {
+            options.lines = number;
+        } else if(flag == "--seed" && numeric) {
+            options.seed = number;
+        } else if(flag == "--fork-depth" && numeric) {
+            options.fork_depth = number;
+        } else if(flag == "--exec-fanout" && numeric && number > 0) {
+            options.exec_fanout = number;
+        } else if(flag == "--program-lines" && numeric) {
+            options.program_lines = number;
+        } else if(flag == "--devices" && numeric && number > 0) {
+            options.devices = number;
+        } else if(flag == "--partitions" && numeric) {
+            options.partitions = number;
+        } else if(flag == "--repeat" && numeric && number > 0) {
+            options.repeat = number;
+        } else if(flag == "--mix") {
+            std::size_t count;
+            auto weights = split_delim<4>(value, ',', count);
+            int w[4];
+            for(size_t k = 0; k < 4; k++) {
+                if(count != 4 || !parse_int(weights[k], w[k]) || w[k] < 0) {
+                    usage();
+                }
+            }
+            options.cpu = w[0];
+            options.syscall = w[1];
+            options.end_io = w[2];
+            options.fork = w[3];
+        } else if(flag == "--emit") {
+            options.emit_dir = std::string(value);
+        } else if(flag == "--log") {
+            options.log_prefix = std::string(value);
+        } else {
+            usage();
+        }
+    }
+
+    return options;
+}
+
+int main(int argc, char** argv) {
+    benchmark_options options = parse_benchmark_args(argc, argv);
+
+    generated_workload workload = generate_workload(options);
+    if(!options.emit_dir.empty()) {
+        emit_workload(workload, options.emit_dir);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    symbol_table symbols;
+    compiled_trace trace = compile_trace(workload.trace);
+    trace.bind(symbols);
+    program_registry programs;
+    for(size_t i = 0; i < workload.external_files.size(); i++) {
+        compiled_trace program = compile_trace(workload.programs[i]);
+        program.bind(symbols);
+        programs.add(symbols.intern(workload.external_files[i].program_name), workload.external_files[i].size,
+                     std::move(program));
+    }
+    double compile_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    simulation_context context{workload.vectors, workload.delays, workload.external_files,
+                               programs, workload.partitions, symbols};
+
+    //the text is not needed any more; keep it out of the RSS measured below
+    size_t trace_lines = workload.trace.size();
+    std::vector<std::string>().swap(workload.trace);
+    workload.programs.clear();
+    reset_peak_rss();
+
+    std::string execution_file = options.log_prefix.empty() ? "/dev/null" : options.log_prefix + "execution.txt";
+    std::string status_file = options.log_prefix.empty() ? "/dev/null" : options.log_prefix + "system_status.txt";
+
+    double best = 0;
+    size_t executions = 0, snapshots = 0, bytes = 0;
+    for(unsigned int run = 0; run < options.repeat; run++) {
+        simulation_arena arena;
+        partition_manager memory(context.partitions, arena.resource());
+        PCB current(0, -1, "init", 1, -1);
+        allocate_memory(memory, &current);
+        process_table processes(symbols);
+        process_queue wait_queue;
+
+        text_log_sink log(execution_file.c_str(), status_file.c_str(), context.vectors);
+        counting_sink sink(log);
+
+        start = std::chrono::steady_clock::now();
+        simulate_trace(trace, 0, 0, context, memory, processes, processes.add(current), wait_queue, sink);
+        log.flush();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if(run == 0 || seconds < best) {
+            best = seconds;
+        }
+        executions = sink.executions;
+        snapshots = sink.snapshots;
+        bytes = log.bytes_written();
+    }
+
+    size_t events = executions + snapshots;
+    std::cout << std::fixed << std::setprecision(3)
+              << "trace lines:       " << trace_lines << "\n"
+              << "compile time:      " << compile_seconds << " s\n"
+              << "events:            " << events << " (" << executions << " execution, "
+                                       << snapshots << " system status)\n"
+              << "log bytes:         " << bytes << "\n"
+              << "simulate time:     " << best << " s (best of " << options.repeat << ")\n"
+              << std::setprecision(0)
+              << "events/s:          " << events / best << "\n"
+              << "log bytes/s:       " << bytes / best << "\n"
+              << "peak RSS:          " << peak_rss_kb() << " KiB" << std::endl;
+
+    return 0;
+}
@@ -1,8 +1,32 @@
 #!/bin/bash
+# Builds the simulator, the benchmark, the trace converter and the log renderer into bin/
+#
+#   ./build.sh                  release build (-O3, link time optimization)
+#   ./build.sh debug            -g -O0
+#   ./build.sh instrumented     -DINTERRUPTS_PROFILE, writes profile.json (or $INTERRUPTS_PROFILE_FILE) at exit
+#   ./build.sh pgo-generate     release build that records a profile when run
+#   ./build.sh pgo-use          release build optimized with the recorded profile
+set -e
+
+case "${1:-release}" in
+    release)        build_type=Release;         pgo= ;;
+    debug)          build_type=Debug;           pgo= ;;
+    instrumented)   build_type=Instrumented;    pgo= ;;
+    pgo-generate)   build_type=Release;         pgo=GENERATE ;;
+    pgo-use)        build_type=Release;         pgo=USE ;;
+    *)
+        echo "Usage: ./build.sh [release|debug|instrumented|pgo-generate|pgo-use]"
+        exit 1
+        ;;
+esac
+
 if [ ! -d "bin" ]; then
     mkdir bin
 else
-    rm bin/*
+    rm -f bin/*
     rm -rf execution.txt
 fi
-g++ -g -O0 -I . -o bin/interrupts interrupts.cpp
+
+cmake -S . -B build -DCMAKE_BUILD_TYPE=$build_type -DINTERRUPTS_PGO=$pgo -DINTERRUPTS_PGO_DIR="$PWD/build/pgo"
+cmake --build build -j"$(nproc 2>/dev/null || echo 2)"
+cp build/interrupts build/benchmark build/trace_converter build/log_renderer bin/
@@ -0,0 +1,1571 @@
+/**
+ *
+ * @file interrupts_core.cpp
+ * @brief the out of line part of the simulator library: loaders, the trace compiler,
+ *        log rendering and analysis, the kernel helpers and checkpoints
+ *
+ * Everything declared in Interrupts_101166589_101257741.hpp that is not a template or
+ * a class member is defined here, once, so the header can be included from any number
+ * of translation units. The simulator, the benchmark, the trace converter and the log
+ * renderer all link against it.
+ *
+ */
+
+#include "Interrupts_101166589_101257741.hpp"
+
+std::vector<memory_partition_t> default_partitions() {
+    return {
+        memory_partition_t(1, 40),
+        memory_partition_t(2, 25),
+        memory_partition_t(3, 15),
+        memory_partition_t(4, 10),
+        memory_partition_t(5, 8),
+        memory_partition_t(6, 2)
+    };
+}
+
+bool allocate_memory(partition_manager& memory, PCB* current) {
+    int partition_number = memory.allocate(current->size);
+    if(partition_number == -1) {
+        return false;
+    }
+    current->partition_number = partition_number;
+    return true;
+}
+
+void free_memory(partition_manager& memory, PCB* process) {
+    memory.free(process->partition_number);
+    process->partition_number = -1;
+}
+
+bool parse_int(std::string_view text, int& value) {
+    std::size_t start = 0;
+    while(start < text.size() && isspace((unsigned char)text[start])) {
+        start++;
+    }
+    if(start < text.size() && text[start] == '+') {
+        start++;
+        if(start < text.size() && text[start] == '-') {
+            return false;
+        }
+    }
+
+    auto [end, ec] = std::from_chars(text.data() + start, text.data() + text.size(), value);
+    return ec == std::errc();
+}
+
+std::tuple<std::string_view, int, std::string_view> parse_trace(std::string_view trace) {
+    PROFILE_SCOPE(PARSE);
+    //split line by ','
+    std::size_t fields;
+    auto parts = split_delim<2>(trace, ',', fields);
+    int duration_intr;
+    if (fields < 2 || !parse_int(parts[1], duration_intr)) {
+        std::cerr << "Error: Malformed input line: " << trace << std::endl;
+        return {"null", -1, "null"};
+    }
+
+    std::string_view activity = parts[0];
+    std::string_view extern_file = "null";
+
+    auto exec = split_delim<2>(parts[0], ' ', fields);
+    if(exec[0] == "EXEC") {
+        extern_file = exec[1];
+        activity = "EXEC";
+    }
+
+    return {activity, duration_intr, extern_file};
+}
+
+trace_instr compile_line(std::string_view line, unsigned int index, std::vector<std::string>& programs,
+                         std::unordered_map<std::string, int>& program_ids) {
+    auto [activity, duration_intr, program_name] = parse_trace(line);
+
+    trace_instr instr{trace_op::NOP, duration_intr, -1, index};
+
+    if(activity == "CPU") {
+        instr.op = trace_op::CPU;
+    } else if(activity == "SYSCALL") {
+        instr.op = trace_op::SYSCALL;
+    } else if(activity == "END_IO") {
+        instr.op = trace_op::END_IO;
+    } else if(activity == "FORK") {
+        instr.op = trace_op::FORK;
+    } else if(activity == "IF_CHILD") {
+        instr.op = trace_op::IF_CHILD;
+    } else if(activity == "IF_PARENT") {
+        instr.op = trace_op::IF_PARENT;
+    } else if(activity == "ENDIF") {
+        instr.op = trace_op::ENDIF;
+    } else if(activity == "EXEC") {
+        instr.op = trace_op::EXEC;
+        auto [it, inserted] = program_ids.try_emplace(std::string(program_name), (int)programs.size());
+        if(inserted) {
+            programs.push_back(it->first);
+        }
+        instr.arg = it->second;
+    }
+
+    return instr;
+}
+
+std::vector<trace_instr> split_fork_child(instr_span block, size_t fork_index, int& parent_index) {
+    std::vector<trace_instr> child;
+    bool skip = true;
+    bool exec_flag = false;
+    parent_index = 0;
+
+    for(size_t j = fork_index; j < block.size(); j++) {
+        trace_op op = block[j].op;
+        if(skip && op == trace_op::IF_CHILD) {
+            skip = false;
+            continue;
+        } else if(op == trace_op::IF_PARENT){
+            skip = true;
+            parent_index = j;
+            if(exec_flag) {
+                break;
+            }
+        } else if(skip && op == trace_op::ENDIF) {
+            skip = false;
+            continue;
+        } else if(!skip && op == trace_op::EXEC) {
+            skip = true;
+            child.push_back(block[j]);
+            exec_flag = true;
+        }
+
+        if(!skip) {
+            child.push_back(block[j]);
+        }
+    }
+
+    return child;
+}
+
+compiled_trace compile_trace(const std::vector<std::string>& lines) {
+    trace_compiler compiler;
+    compiler.reserve(lines.size());
+    for(const auto& line : lines) {
+        compiler.add_line(line);
+    }
+    return compiler.finish();
+}
+
+bool compile_trace(const std::vector<std::string>& lines, compiled_trace& trace, std::string& error) {
+    //checked up front, since parse_trace reports a malformed line and goes on
+    for(size_t i = 0; i < lines.size(); i++) {
+        std::size_t fields;
+        auto parts = split_delim<2>(lines[i], ',', fields);
+        int duration;
+        if(fields < 2 || !parse_int(parts[1], duration)) {
+            error = "Malformed input line " + std::to_string(i + 1) + ": " + lines[i];
+            return false;
+        }
+    }
+
+    trace = compile_trace(lines);
+    return true;
+}
+
+bool write_binary_trace(const compiled_trace& trace, const std::string& filename) {
+    std::ofstream output_file(filename, std::ios::binary);
+    if(!output_file.is_open()) {
+        return false;
+    }
+
+    binary_trace_header header{};
+    std::copy(BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC + 8, header.magic);
+    header.byte_order   = 0x01020304;
+    header.instr_size   = sizeof(trace_instr);
+    header.instr_count  = trace.code().size();
+    header.block_count  = trace.block_count();
+    header.fork_count   = trace.fork_count();
+    header.string_count = trace.program_count();
+    for(size_t i = 0; i < trace.program_count(); i++) {
+        header.string_bytes += trace.program(i).size();
+    }
+    binary_trace_layout layout(header);
+
+    std::uint64_t position = 0;
+    auto write = [&](const void* data, size_t size) {
+        output_file.write((const char*)data, size);
+        position += size;
+    };
+    auto pad_to = [&](std::uint64_t offset) {
+        const char zeros[8] = {};
+        write(zeros, offset - position);
+    };
+
+    write(&header, sizeof(header));
+    pad_to(layout.instrs);
+    for(size_t i = 0; i < trace.code().size(); i++) {
+        //copied field by field so the padding bytes are written as zeros
+        trace_instr record;
+        std::memset(&record, 0, sizeof(record));
+        record.op       = trace.code()[i].op;
+        record.operand  = trace.code()[i].operand;
+        record.arg      = trace.code()[i].arg;
+        record.line     = trace.code()[i].line;
+        write(&record, sizeof(record));
+    }
+    pad_to(layout.blocks);
+    for(size_t i = 0; i < trace.block_count(); i++) {
+        write(&trace.range(i), sizeof(block_range));
+    }
+    pad_to(layout.forks);
+    for(size_t i = 0; i < trace.fork_count(); i++) {
+        write(&trace.fork(i), sizeof(fork_target));
+    }
+    pad_to(layout.string_offsets);
+    std::uint64_t offset = 0;
+    write(&offset, sizeof(offset));
+    for(size_t i = 0; i < trace.program_count(); i++) {
+        offset += trace.program(i).size();
+        write(&offset, sizeof(offset));
+    }
+    for(size_t i = 0; i < trace.program_count(); i++) {
+        write(trace.program(i).data(), trace.program(i).size());
+    }
+
+    return (bool)output_file;
+}
+
+bool is_binary_trace(const std::string& filename) {
+    std::ifstream input_file(filename, std::ios::binary);
+    char magic[8] = {};
+    input_file.read(magic, sizeof(magic));
+    return input_file && std::equal(magic, magic + 8, BINARY_TRACE_MAGIC);
+}
+
+bool read_binary_trace(const std::string& filename, compiled_trace& trace, std::string& error) {
+    auto fail = [&](const char* reason) {
+        error = "Invalid binary trace " + filename + ": " + reason;
+        return false;
+    };
+
+    mapped_file file;
+    if(!file.open(filename) || file.size() < sizeof(binary_trace_header)) {
+        return fail("unable to read the header");
+    }
+
+    binary_trace_header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if(!std::equal(header.magic, header.magic + 8, BINARY_TRACE_MAGIC)) {
+        return fail("bad magic");
+    }
+    if(header.byte_order != 0x01020304 || header.instr_size != sizeof(trace_instr)) {
+        return fail("written on a machine with a different byte order or layout");
+    }
+
+    const std::uint64_t limit = file.size();
+    if(header.instr_count > limit / sizeof(trace_instr) || header.block_count > limit / sizeof(block_range)
+       || header.fork_count > limit / sizeof(fork_target) || header.string_count > limit / sizeof(std::uint64_t)
+       || header.string_bytes > limit) {
+        return fail("truncated");
+    }
+    binary_trace_layout layout(header);
+    if(layout.end > limit) {
+        return fail("truncated");
+    }
+
+    const char* base = file.data();
+    instr_span code{(const trace_instr*)(base + layout.instrs), (size_t)header.instr_count};
+    const block_range* blocks = (const block_range*)(base + layout.blocks);
+    const fork_target* forks = (const fork_target*)(base + layout.forks);
+    const std::uint64_t* string_offsets = (const std::uint64_t*)(base + layout.string_offsets);
+
+    for(size_t i = 0; i < header.block_count; i++) {
+        if(blocks[i].offset > header.instr_count || blocks[i].count > header.instr_count - blocks[i].offset) {
+            return fail("block out of range");
+        }
+    }
+    for(size_t i = 0; i < header.fork_count; i++) {
+        if(forks[i].child_block < 0 || (std::uint64_t)forks[i].child_block >= header.block_count
+           || forks[i].parent_index < 0) {
+            return fail("fork target out of range");
+        }
+    }
+    for(size_t i = 0; i < code.size(); i++) {
+        const trace_instr& instr = code[i];
+        if(instr.op > trace_op::ENDIF
+           || (instr.op == trace_op::FORK && (instr.arg < 0 || (std::uint64_t)instr.arg >= header.fork_count))
+           || (instr.op == trace_op::EXEC && (instr.arg < 0 || (std::uint64_t)instr.arg >= header.string_count))) {
+            return fail("instruction out of range");
+        }
+    }
+
+    std::vector<std::string> programs;
+    programs.reserve(header.string_count);
+    for(size_t i = 0; i < header.string_count; i++) {
+        if(string_offsets[i] > string_offsets[i + 1] || string_offsets[i + 1] > header.string_bytes) {
+            return fail("string out of range");
+        }
+        programs.emplace_back(base + layout.strings + string_offsets[i], string_offsets[i + 1] - string_offsets[i]);
+    }
+
+    //block 0 is the trace itself and must exist even when it is empty
+    if(header.block_count == 0) {
+        return fail("no blocks");
+    }
+
+    trace = compiled_trace(std::move(file), code, blocks, header.block_count, forks, header.fork_count,
+                           std::move(programs));
+    return true;
+}
+
+bool check_devices(const compiled_trace& trace, const std::vector<std::string>& vectors,
+                   const std::vector<int>& delays, std::string& error) {
+    const int devices = (int)std::min(vectors.size(), delays.size());
+    instr_span code = trace.code();
+    for(size_t i = 0; i < code.size(); i++) {
+        const trace_instr& instr = code[i];
+        int vector = -1;
+        if(instr.op == trace_op::SYSCALL || instr.op == trace_op::END_IO) {
+            vector = instr.operand;
+        } else if(instr.op == trace_op::FORK) {
+            vector = FORK_VECTOR;
+        } else if(instr.op == trace_op::EXEC) {
+            vector = EXEC_VECTOR;
+        } else {
+            continue;
+        }
+
+        if(vector < 0 || vector >= devices) {
+            error = "Input line " + std::to_string(instr.line + 1) + ": " + std::string(trace_op_name(instr.op))
+                    + " raises interrupt " + std::to_string(vector) + ", which the vector and device tables do not have";
+            return false;
+        }
+    }
+    return true;
+}
+
+compiled_trace load_binary_trace(const std::string& filename) {
+    compiled_trace trace;
+    std::string error;
+    if(!read_binary_trace(filename, trace, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        exit(1);
+    }
+    return trace;
+}
+
+compiled_trace load_trace(const std::string& filename) {
+    if(is_binary_trace(filename)) {
+        return load_binary_trace(filename);
+    }
+
+    chunked_line_reader input_file(filename);
+    trace_compiler compiler;
+    std::string_view line;
+    while(input_file.next(line)) {
+        compiler.add_line(line);
+    }
+
+    return compiler.finish();
+}
+
+void open_table(std::ifstream& input_file, const std::string& filename) {
+    input_file.open(filename);
+    if (!input_file.is_open()) {
+        std::cerr << "Error: Unable to open file: " << filename << std::endl;
+        exit(1);
+    }
+}
+
+std::vector<std::string> load_vector_table(const std::string& filename) {
+    std::ifstream input_file;
+    open_table(input_file, filename);
+
+    std::string vector;
+    std::vector<std::string> vectors;
+    while(std::getline(input_file, vector)) {
+        vectors.push_back(vector);
+    }
+
+    return vectors;
+}
+
+std::vector<int> load_device_table(const std::string& filename) {
+    std::ifstream input_file;
+    open_table(input_file, filename);
+
+    std::string duration;
+    std::vector<int> delays;
+    while(std::getline(input_file, duration)) {
+        int delay;
+        if(!parse_int(duration, delay)) {
+            std::cerr << "Error: Malformed device delay: " << duration << std::endl;
+            exit(1);
+        }
+        delays.push_back(delay);
+    }
+
+    return delays;
+}
+
+std::vector<external_file> load_external_files(const std::string& filename) {
+    std::ifstream input_file;
+    open_table(input_file, filename);
+
+    std::vector<external_file> external_files;
+    std::string file_content;
+    while(std::getline(input_file, file_content)) {
+        if(file_content.empty()) {
+            continue;
+        }
+
+        external_file entry;
+        std::size_t fields;
+        auto file_info      = split_delim<2>(file_content, ',', fields);
+        int size;
+
+        if(fields < 2 || !parse_int(file_info[1], size)) {
+            std::cerr << "Error: Malformed external file entry: " << file_content << std::endl;
+            exit(1);
+        }
+
+        entry.program_name  = std::string(file_info[0]);
+        entry.size          = size;
+        external_files.push_back(entry);
+    }
+
+    return external_files;
+}
+
+std::vector<memory_partition_t> load_partition_table(const std::string& filename) {
+    std::ifstream input_file;
+    open_table(input_file, filename);
+
+    std::vector<memory_partition_t> partitions;
+    std::string partition;
+    while(std::getline(input_file, partition)) {
+        if(partition.empty()) {
+            continue;
+        }
+
+        int size;
+        if(!parse_int(partition, size) || size < 0) {
+            std::cerr << "Error: Malformed partition size: " << partition << std::endl;
+            exit(1);
+        }
+        partitions.emplace_back(partitions.size() + 1, size);
+    }
+
+    return partitions;
+}
+
+simulation_context parse_args(int argc, char** argv, table_cache& tables) {
+    if(argc != 5 && argc != 6) {
+        std::cout << "ERROR!\nExpected 4 or 5 arguments, received " << argc - 1 << std::endl;
+        std::cout << "To run the program, do: ./interrutps <your_trace_file.txt> <your_vector_table.txt> <your_device_table.txt> <your_external_files.txt> [your_partition_table.txt] [--costs=standard|hardware-save] [--io=serial|overlapped] [--scheduler=fcfs|rr|priority|mlfq] [--quantum=N] [--cores=N] [--coalesce-end-io=W] [--memoize-exec] [--checkpoint-every=N] [--checkpoint-at=N,...] [--resume=<checkpoint>] [--sweep=<your_sweep.txt> [--jobs=N]] [--binary-log | --stats | --analyze | --status-deltas[=N]]" << std::endl;
+        std::cout << "or, to run every job of a manifest: ./interrutps --batch <your_manifest.txt> [--jobs=N]" << std::endl;
+        exit(1);
+    }
+
+    std::ifstream input_file;
+    open_table(input_file, argv[1]);
+    input_file.close();
+
+    //The partition table is optional
+    return tables.context(argv[2], argv[3], argv[4], argc == 6 ? argv[5] : "");
+}
+
+std::string_view trim(std::string_view text) {
+    while(!text.empty() && isspace((unsigned char)text.front())) {
+        text.remove_prefix(1);
+    }
+    while(!text.empty() && isspace((unsigned char)text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+std::vector<batch_job> load_manifest(const std::string& filename) {
+    std::ifstream input_file;
+    open_table(input_file, filename);
+
+    std::vector<batch_job> jobs;
+    std::string line;
+    while(std::getline(input_file, line)) {
+        std::string_view entry = trim(line);
+        if(entry.empty() || entry.front() == '#') {
+            continue;
+        }
+
+        std::size_t count;
+        auto fields = split_delim<6>(entry, ',', count);
+        if(count < 5) {
+            std::cerr << "Error: Malformed manifest entry: " << line << std::endl;
+            exit(1);
+        }
+
+        jobs.push_back({std::string(trim(fields[0])), std::string(trim(fields[1])),
+                        std::string(trim(fields[2])), std::string(trim(fields[3])),
+                        std::string(trim(fields[4])), std::string(trim(fields[5]))});
+    }
+
+    return jobs;
+}
+
+bool parse_sweep_values(std::string_view text, std::vector<int>& values) {
+    while(!text.empty()) {
+        size_t comma = text.find(',');
+        std::string_view item = trim(text.substr(0, comma));
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+
+        size_t dots = item.find("..");
+        int low = 0, high = 0, step = 1;
+        if(dots == std::string_view::npos) {
+            if(!parse_int(item, low)) {
+                return false;
+            }
+            high = low;
+        } else {
+            std::string_view rest = item.substr(dots + 2);
+            size_t colon = rest.find(':');
+            if(!parse_int(item.substr(0, dots), low) || !parse_int(rest.substr(0, colon), high)
+               || (colon != std::string_view::npos && !parse_int(rest.substr(colon + 1), step)) || step < 1) {
+                return false;
+            }
+        }
+        for(long long value = low; value <= high; value += step) {
+            values.push_back(value);
+        }
+    }
+    return true;
+}
+
+sweep_spec load_sweep(const std::string& filename) {
+    std::ifstream input_file;
+    open_table(input_file, filename);
+
+    sweep_spec spec;
+    std::string line;
+    while(std::getline(input_file, line)) {
+        std::string_view entry = trim(line);
+        if(entry.empty() || entry.front() == '#') {
+            continue;
+        }
+
+        size_t colon = entry.find(':');
+        std::string_view name = trim(entry.substr(0, colon));
+        std::string_view values = colon == std::string_view::npos ? std::string_view() : entry.substr(colon + 1);
+
+        bool valid = colon != std::string_view::npos;
+        if(valid && (name == "device_table" || name == "partition_table")) {
+            auto& files = name == "device_table" ? spec.device_tables : spec.partition_tables;
+            while(!values.empty()) {
+                size_t comma = values.find(',');
+                std::string_view file = trim(values.substr(0, comma));
+                files.emplace_back(name == "partition_table" && file == "default" ? "" : file);
+                values = comma == std::string_view::npos ? std::string_view() : values.substr(comma + 1);
+            }
+        } else if(valid && name == "delay_scale") {
+            valid = parse_sweep_values(values, spec.delay_scales);
+        } else if(valid && name == "context_save") {
+            valid = parse_sweep_values(values, spec.context_saves);
+        } else {
+            valid = false;
+        }
+
+        if(!valid) {
+            std::cerr << "Error: Malformed sweep entry: " << line << std::endl;
+            exit(1);
+        }
+    }
+
+    return spec;
+}
+
+std::string_view trace_op_name(trace_op op) {
+    switch(op) {
+        case trace_op::CPU:        return "CPU";
+        case trace_op::SYSCALL:    return "SYSCALL";
+        case trace_op::END_IO:     return "END_IO";
+        case trace_op::FORK:       return "FORK";
+        case trace_op::EXEC:       return "EXEC";
+        case trace_op::IF_CHILD:   return "IF_CHILD";
+        case trace_op::IF_PARENT:  return "IF_PARENT";
+        case trace_op::ENDIF:      return "ENDIF";
+        default:                   return "null";
+    }
+}
+
+bool trace_op_from_name(std::string_view name, trace_op& op) {
+    for(int i = (int)trace_op::CPU; i <= (int)trace_op::ENDIF; i++) {
+        if(trace_op_name((trace_op)i) == name) {
+            op = (trace_op)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view event_kind_name(event_kind kind) {
+    static constexpr std::string_view names[] = {
+        "CPU_BURST", "SWITCH_TO_KERNEL", "CONTEXT_SAVED", "FIND_VECTOR", "LOAD_ADDRESS", "SYSCALL_ISR",
+        "ENDIO_ISR", "RUN_SYSCALL_ISR", "RUN_ENDIO_ISR", "IRET", "CONTEXT_RESTORED", "SWITCH_TO_USER",
+        "CLONE_PCB", "SCHEDULER_CALLED", "PROGRAM_SIZE", "LOAD_PROGRAM", "MARK_PARTITION", "UPDATE_PCB",
+        "FORK_PARTITION_ERROR", "EXEC_NOT_FOUND_ERROR", "EXEC_PARTITION_ERROR", "START_IO", "CPU_IDLE",
+        "MEMORY_WAIT", "END_IO_COALESCED"
+    };
+    static_assert(std::size(names) == (size_t)last_event_kind + 1, "every event kind needs a name");
+    return names[(size_t)kind];
+}
+
+void put_pcb_row(buffered_writer& out, const process_table& processes, int slot, std::string_view state) {
+    out.put("|   ");
+    out.put_int(processes.PID[slot]);
+    out.put(" |    ");
+    out.put(processes.program_name(processes.program[slot]));
+    out.put(" |               ");
+    out.put_int(processes.partition_number[slot]);
+    out.put(" |    ");
+    out.put_int(processes.size[slot]);
+    out.put(" | ");
+    out.put(state);
+    out.put(" |\n");
+}
+
+void put_status_table(buffered_writer& out, int time, trace_op trace, int duration,
+                      const process_table& processes, int running, waiting_view waiting) {
+    out.put("time: ");
+    out.put_int(time);
+    out.put("; current trace: ");
+    out.put(trace_op_name(trace));
+    out.put(", ");
+    out.put_int(duration);
+    out.put("\n");
+    out.put("+------------------------------------------------------+\n");
+    out.put("| PID |program name |partition number | size |   state |\n");
+    out.put("+------------------------------------------------------+\n");
+
+    // Show running process
+    put_pcb_row(out, processes, running, "running");
+
+    // Show all waiting processes
+    for (int slot : waiting) {
+        put_pcb_row(out, processes, slot, "waiting");
+    }
+
+    out.put("+------------------------------------------------------+\n\n");
+}
+
+bool materialize_status_deltas(const std::string& delta_file, const std::string& status_file) {
+    std::ifstream input_file(delta_file);
+    buffered_writer out(status_file.c_str());
+    if(!input_file.is_open() || !out.is_open()) {
+        return false;
+    }
+
+    size_t line_number = 0;
+    std::string line;
+    auto fail = [&]() {
+        std::cerr << "Error: Malformed status delta at " << delta_file << ":" << line_number << std::endl;
+        exit(1);
+    };
+    auto next_line = [&]() {
+        line_number++;
+        return (bool)std::getline(input_file, line);
+    };
+    symbol_table symbols;
+    process_table processes(symbols);
+
+    //PID, name, partition and size, split by 'delim', into 'slot'
+    auto parse_row = [&](std::string_view text, char delim, int slot) {
+        size_t count;
+        auto fields = split_delim<5>(text, delim, count);
+        int pid, partition, size;
+        if(count < 4 || !parse_int(trim(fields[0]), pid) || !parse_int(trim(fields[2]), partition)
+           || !parse_int(trim(fields[3]), size)) {
+            fail();
+        }
+        processes.set(slot, pid, -1, symbols.intern(std::string(trim(fields[1]))), size, partition);
+    };
+
+    const int running = processes.add(0, -1, 0, 0, -1);
+    const int head = processes.add(0, -1, 0, 0, -1);
+    std::vector<int> queue;
+    auto truncate_queue = [&](size_t count) {
+        for(size_t i = count; i < queue.size(); i++) {
+            processes.remove(queue[i]);
+        }
+        queue.erase(queue.begin() + count, queue.end());
+    };
+    auto push_queue = [&]() {
+        queue.push_back(processes.add(0, -1, 0, 0, -1));
+        return queue.back();
+    };
+
+    while(next_line()) {
+        if(line.empty()) {
+            continue;
+        }
+
+        //time: <time>; current trace: <trace>, <duration>
+        std::string_view header = line;
+        size_t trace_at = header.find("; current trace: ");
+        size_t comma = header.rfind(", ");
+        int time, duration;
+        trace_op trace;
+        if(header.substr(0, 6) != "time: " || trace_at == std::string_view::npos || comma == std::string_view::npos
+           || comma < trace_at || !parse_int(header.substr(6, trace_at - 6), time)
+           || !trace_op_from_name(header.substr(trace_at + 17, comma - trace_at - 17), trace)
+           || !parse_int(header.substr(comma + 2), duration)) {
+            fail();
+        }
+
+        bool has_head = false;
+        if(input_file.peek() == '+') {
+            //a full table: the first row runs, a FORK's parent waits ahead of the queue
+            for(int i = 0; i < 3; i++) {
+                next_line();
+            }
+            bool first = true;
+            truncate_queue(0);
+            while(next_line() && line.compare(0, 1, "+") != 0) {
+                std::string_view row = std::string_view(line).substr(1);
+                if(first) {
+                    parse_row(row, '|', running);
+                    first = false;
+                } else if(trace == trace_op::FORK && !has_head) {
+                    parse_row(row, '|', head);
+                    has_head = true;
+                } else {
+                    parse_row(row, '|', push_queue());
+                }
+            }
+            if(first) {
+                fail();
+            }
+        } else {
+            while(next_line() && !line.empty()) {
+                std::string_view row = line;
+                if(row.substr(0, 9) == "running: ") {
+                    parse_row(row.substr(9), ',', running);
+                } else if(row.substr(0, 9) == "waiting: ") {
+                    parse_row(row.substr(9), ',', head);
+                    has_head = true;
+                } else if(row.substr(0, 6) == "keep: ") {
+                    int kept;
+                    if(!parse_int(row.substr(6), kept) || kept < 0 || (size_t)kept > queue.size()) {
+                        fail();
+                    }
+                    truncate_queue(kept);
+                } else if(row.substr(0, 7) == "queue: ") {
+                    parse_row(row.substr(7), ',', push_queue());
+                } else {
+                    fail();
+                }
+            }
+        }
+
+        put_status_table(out, time, trace, duration, processes, running, {has_head ? head : -1, queue});
+    }
+
+    return true;
+}
+
+bool replay_binary_log(const std::string& log_file,
+                       const std::function<event_sink*(const std::vector<std::string>& vectors)>& open_sink) {
+    auto fail = [&](const char* reason) {
+        std::cerr << "Error: Invalid binary log " << log_file << ": " << reason << std::endl;
+        exit(1);
+    };
+
+    mapped_file file;
+    if(!file.open(log_file) || file.size() < sizeof(log_header)) {
+        fail("unable to read the header");
+    }
+
+    log_header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if(!std::equal(header.magic, header.magic + 8, EVENT_LOG_MAGIC)) {
+        fail("bad magic");
+    }
+    if(header.byte_order != 0x01020304 || header.word_size != sizeof(log_record)) {
+        fail("written on a machine with a different byte order or layout");
+    }
+
+    const char* next = file.data() + sizeof(log_header);
+    const char* end = file.data() + file.size();
+    auto peek_header = [&]() {
+        log_record record;
+        std::memcpy(&record, next, sizeof(record));
+        return record;
+    };
+    auto read_words = [&](std::int32_t* words, size_t count) {
+        if((size_t)(end - next) < count * sizeof(std::int32_t)) {
+            fail("truncated record");
+        }
+        std::memcpy(words, next, count * sizeof(std::int32_t));
+        next += count * sizeof(std::int32_t);
+    };
+    auto read_header = [&]() {
+        log_record record = peek_header();
+        next += sizeof(record);
+        return record;
+    };
+    auto read_string = [&](std::vector<std::string>& table) {
+        std::int32_t words[2];
+        read_words(words, 2);
+        size_t padded = ((size_t)words[1] + sizeof(log_record) - 1) / sizeof(log_record) * sizeof(log_record);
+        if(words[0] < 0 || words[1] < 0 || (size_t)(end - next) < padded) {
+            fail("truncated string");
+        }
+        if(table.size() <= (size_t)words[0]) {
+            table.resize(words[0] + 1);
+        }
+        table[words[0]].assign(next, words[1]);
+        next += padded;
+        return words[0];
+    };
+
+    //the vector table comes first and the text sink needs it up front
+    std::vector<std::string> vectors;
+    std::vector<std::string> names;
+    while((size_t)(end - next) >= sizeof(log_record) && peek_header().type == (std::uint8_t)log_record_type::STRING
+          && peek_header().code == (std::uint8_t)string_kind::VECTOR) {
+        read_header();
+        read_string(vectors);
+    }
+
+    event_sink* opened = open_sink(vectors);
+    if(opened == nullptr) {
+        return false;
+    }
+    event_sink& sink = *opened;
+
+    //the rows of a table are read into the same slots every time
+    symbol_table symbols;
+    process_table processes(symbols);
+    std::vector<int> programs;      //!< symbol of each program name of the log
+    const int running = processes.add(0, -1, 0, 0, -1);
+    std::vector<int> row_slots;
+    std::vector<int> waiting;
+    auto read_row = [&](int slot) {
+        if((size_t)(end - next) < sizeof(log_record)) {
+            fail("truncated system status");
+        }
+        log_record record = read_header();
+        std::int32_t words[3];
+        read_words(words, 3);
+        if(record.type != (std::uint8_t)log_record_type::PCB_ROW || record.small >= programs.size()
+           || programs[record.small] == -1) {
+            fail("bad PCB row");
+        }
+        processes.set(slot, words[0], -1, programs[record.small], words[2], words[1]);
+    };
+
+    int next_time = 0;
+    while((size_t)(end - next) >= sizeof(log_record)) {
+        log_record record = read_header();
+        std::int32_t words[3] = {next_time, record.small, 0};
+
+        switch((log_record_type)record.type) {
+            case log_record_type::EXECUTION:
+            case log_record_type::EXECUTION_OPERAND:
+            case log_record_type::EXECUTION_FULL:
+                if(record.type == (std::uint8_t)log_record_type::EXECUTION_OPERAND) {
+                    read_words(words + 2, 1);
+                } else if(record.type == (std::uint8_t)log_record_type::EXECUTION_FULL) {
+                    read_words(words, 3);
+                }
+                if(record.code > (std::uint8_t)last_event_kind) {
+                    fail("unknown event");
+                }
+                sink.execution(words[0], words[1], (event_kind)record.code, words[2]);
+                next_time = words[0] + words[1];
+                break;
+            case log_record_type::STATUS:
+                read_words(words, 3);
+                if(record.code > (std::uint8_t)trace_op::ENDIF || words[2] < 1) {
+                    fail("bad system status");
+                }
+                while(row_slots.size() < (size_t)words[2] - 1) {
+                    row_slots.push_back(processes.add(0, -1, processes.program[running], 0, -1));
+                }
+                waiting.assign(row_slots.begin(), row_slots.begin() + words[2] - 1);
+                read_row(running);
+                for(int slot : waiting) {
+                    read_row(slot);
+                }
+                sink.system_status(words[0], (trace_op)record.code, words[1], processes, running, {-1, waiting});
+                break;
+            case log_record_type::STRING:
+                if(record.code == (std::uint8_t)string_kind::VECTOR) {
+                    read_string(vectors);
+                } else {
+                    int id = read_string(names);
+                    programs.resize(names.size(), -1);
+                    programs[id] = symbols.intern(names[id]);
+                }
+                break;
+            case log_record_type::CORE:
+                sink.core_changed(record.small);
+                break;
+            default:
+                fail("unknown record");
+        }
+    }
+
+    return true;
+}
+
+bool render_binary_log(const std::string& log_file, const std::string& execution_file,
+                       const std::string& status_file) {
+    std::unique_ptr<text_log_sink> sink;
+    bool opened = replay_binary_log(log_file, [&](const std::vector<std::string>& vectors) -> event_sink* {
+        sink = std::make_unique<text_log_sink>(execution_file.c_str(), status_file.c_str(), vectors);
+        return sink->is_open() ? sink.get() : nullptr;
+    });
+    if(opened) {
+        sink->flush();
+    }
+    return opened;
+}
+
+std::int64_t max_end(const std::int32_t* times, const std::int32_t* durations, size_t count) {
+    std::int64_t end = 0;
+    for(size_t i = 0; i < count; i++) {
+        end = std::max(end, (std::int64_t)times[i] + durations[i]);
+    }
+    return end;
+}
+
+timeline_analysis analyze_timeline(const timeline_sink& timeline) {
+    timeline_analysis result;
+    const size_t count = timeline.size();
+    const std::uint8_t* kinds = timeline.kinds.data();
+    const std::int32_t* times = timeline.times.data();
+    const std::int32_t* durations = timeline.durations.data();
+    const std::int32_t* devices = timeline.devices.data();
+
+    result.events = count;
+    result.total_time = max_end(times, durations, count);
+    for(size_t i = 0; i < count; i++) {
+        result.busy[kinds[i]] += durations[i];
+        result.counts[kinds[i]]++;
+    }
+
+    //interrupts do not nest, so the n-th switch to kernel mode goes with the n-th IRET
+    std::vector<std::int32_t> starts, ends;
+    starts.reserve(result.counts[(size_t)event_kind::SWITCH_TO_KERNEL]);
+    ends.reserve(result.counts[(size_t)event_kind::IRET]);
+    for(size_t i = 0; i < count; i++) {
+        if(kinds[i] == (std::uint8_t)event_kind::SWITCH_TO_KERNEL) {
+            starts.push_back(times[i]);
+        } else if(kinds[i] == (std::uint8_t)event_kind::IRET) {
+            ends.push_back(times[i] + durations[i]);
+        }
+    }
+
+    result.interrupts = std::min(starts.size(), ends.size());
+    result.min_latency = result.interrupts > 0 ? ends[0] - starts[0] : 0;
+    result.latency_histogram.resize(33);
+    for(size_t i = 0; i < result.interrupts; i++) {
+        const std::int32_t latency = ends[i] - starts[i];
+        result.min_latency = std::min<std::int64_t>(result.min_latency, latency);
+        result.max_latency = std::max<std::int64_t>(result.max_latency, latency);
+        result.total_latency += latency;
+
+        size_t bits = 0;
+        for(std::uint32_t rest = latency; rest != 0; rest >>= 1) {
+            bits++;
+        }
+        result.latency_histogram[bits]++;
+    }
+    while(!result.latency_histogram.empty() && result.latency_histogram.back() == 0) {
+        result.latency_histogram.pop_back();
+    }
+
+    //ISR time per device; other kinds are masked to nothing rather than skipped
+    static constexpr event_kind isr_kinds[] = {event_kind::SYSCALL_ISR, event_kind::ENDIO_ISR, event_kind::RUN_SYSCALL_ISR,
+                                               event_kind::RUN_ENDIO_ISR, event_kind::START_IO};
+    std::array<std::int32_t, timeline_analysis::kind_count> isr_mask{};
+    for(event_kind kind : isr_kinds) {
+        isr_mask[(size_t)kind] = -1;
+    }
+    std::int32_t last_device = -1;
+    for(size_t i = 0; i < count; i++) {
+        last_device = std::max(last_device, devices[i]);
+    }
+    std::vector<std::int64_t> device_busy(last_device + 2);    //slot 0: before the first interrupt
+    for(size_t i = 0; i < count; i++) {
+        device_busy[devices[i] + 1] += durations[i] & isr_mask[kinds[i]];
+    }
+    result.device_busy.assign(device_busy.begin() + 1, device_busy.end());
+
+    return result;
+}
+
+void report_timeline(std::ostream& out, const timeline_analysis& analysis) {
+    auto percent = [&](std::int64_t time) {
+        char text[16];
+        snprintf(text, sizeof(text), "%.1f%%", analysis.total_time > 0 ? 100.0 * time / analysis.total_time : 0.0);
+        return std::string(text);
+    };
+
+    out << "events: " << analysis.events << "\n"
+        << "total time: " << analysis.total_time << "\n";
+
+    for(size_t kind = 0; kind < timeline_analysis::kind_count; kind++) {
+        if(analysis.counts[kind] > 0) {
+            out << event_kind_name((event_kind)kind) << ": " << analysis.counts[kind] << " event(s), "
+                << analysis.busy[kind] << " busy, " << percent(analysis.busy[kind]) << "\n";
+        }
+    }
+
+    out << "interrupts: " << analysis.interrupts;
+    if(analysis.interrupts > 0) {
+        char mean[32];
+        snprintf(mean, sizeof(mean), "%.1f", (double)analysis.total_latency / analysis.interrupts);
+        out << ", latency " << analysis.min_latency << " min, " << mean << " mean, " << analysis.max_latency << " max";
+    }
+    out << "\n";
+    for(size_t bits = 0; bits < analysis.latency_histogram.size(); bits++) {
+        if(analysis.latency_histogram[bits] > 0) {
+            std::int64_t low = bits == 0 ? 0 : std::int64_t(1) << (bits - 1);
+            std::int64_t high = bits == 0 ? 0 : (std::int64_t(1) << bits) - 1;
+            out << "latency " << low << ".." << high << ": " << analysis.latency_histogram[bits] << "\n";
+        }
+    }
+
+    for(size_t device = 0; device < analysis.device_busy.size(); device++) {
+        if(analysis.device_busy[device] > 0) {
+            out << "device " << device << ": " << analysis.device_busy[device] << " ISR time, "
+                << percent(analysis.device_busy[device]) << " utilization\n";
+        }
+    }
+}
+
+bool analyze_binary_log(const std::string& log_file, const std::string& analysis_file) {
+    std::ofstream output_file(analysis_file);
+    if(!output_file.is_open()) {
+        return false;
+    }
+
+    timeline_sink timeline;
+    if(!replay_binary_log(log_file, [&](const std::vector<std::string>& /*vectors*/) -> event_sink* {
+        return &timeline;
+    })) {
+        return false;
+    }
+    report_timeline(output_file, analyze_timeline(timeline));
+    return true;
+}
+
+void print_external_files(const std::vector<external_file>& files) {
+    const int tableWidth = 24;
+
+    std::cout << "List of external files (" << files.size() << " entry(s)): " << std::endl;
+    
+    // Print top border
+    std::cout << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
+    
+    // Print headers
+    std::cout << "|"
+              << std::setfill(' ') << std::setw(10) << "file name"
+              << std::setw(2) << "|"
+              << std::setfill(' ') << std::setw(10) << "files size"
+              << std::setw(2) << "|" << std::endl;
+    
+    // Print separator
+    std::cout << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
+    
+    // Print each PCB entry
+    for (const auto& file : files) {
+        std::cout << "|"
+                  << std::setfill(' ') << std::setw(10) << file.program_name
+                  << std::setw(2) << "|"
+                  << std::setw(10) << file.size
+                  << std::setw(2) << "|" << std::endl;
+    }
+    
+    // Print bottom border
+    std::cout << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
+}
+
+std::string print_PCB(const PCB& current, const std::vector<PCB>& _PCB) {
+    const int tableWidth = 55;
+
+    std::stringstream buffer;
+    
+    // Print top border
+    buffer << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
+    
+    // Print headers
+    buffer << "|"
+              << std::setfill(' ') << std::setw(4) << "PID"
+              << std::setw(2) << "|"
+              << std::setfill(' ') << std::setw(12) << "program name"
+              << std::setw(2) << "|"
+              << std::setfill(' ') << std::setw(16) << "partition number"
+              << std::setw(2) << "|"
+              << std::setfill(' ') << std::setw(5) << "size"
+              << std::setw(2) << "|" 
+              << std::setfill(' ') << std::setw(8) << "state"
+              << std::setw(2) << "|" << std::endl;
+    
+    // Print separator
+    buffer << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
+
+    buffer << "|"
+                  << std::setfill(' ') << std::setw(4) << current.PID
+                  << std::setw(2) << "|"
+                  << std::setw(12) << current.program_name
+                  << std::setw(2) << "|"
+                  << std::setw(16) << current.partition_number
+                  << std::setw(2) << "|"
+                  << std::setw(5) << current.size
+                  << std::setw(2) << "|"
+                  << std::setw(8) << "running"
+                  << std::setw(2) << "|" << std::endl;
+    
+    // Print each PCB entry
+    for (const auto& program : _PCB) {
+        buffer << "|"
+                  << std::setfill(' ') << std::setw(4) << program.PID
+                  << std::setw(2) << "|"
+                  << std::setw(12) << program.program_name
+                  << std::setw(2) << "|"
+                  << std::setw(16) << program.partition_number
+                  << std::setw(2) << "|"
+                  << std::setw(5) << program.size
+                  << std::setw(2) << "|"
+                  << std::setw(8) << "waiting"
+                  << std::setw(2) << "|" << std::endl;
+    }
+    
+    // Print bottom border
+    buffer << "+" << std::setfill('-') << std::setw(tableWidth) << "+" << std::endl;
+
+    return buffer.str();
+}
+
+unsigned int get_size(const std::string& name, const std::vector<external_file>& external_files) {
+    int size = -1;
+
+    for (const auto& file : external_files) { 
+        if(file.program_name == name){
+            size = file.size;
+            break;
+        }
+    }
+
+    return size;
+}
+
+void print_exec_debug(const std::string& program_name) {
+    std::cerr << "DEBUG: EXEC activity - program_name = '" << program_name << "'" << std::endl;
+}
+
+void event_sink::exec_debug_line(const std::string& program_name) {
+    print_exec_debug(program_name);
+}
+
+std::uint64_t trace_fingerprint(const compiled_trace& trace) {
+    std::uint64_t hash = 1469598103934665603ull;
+    auto add = [&](std::uint64_t value) {
+        hash = (hash ^ value) * 1099511628211ull;
+    };
+
+    for(size_t i = 0; i < trace.code().size(); i++) {
+        add((std::uint64_t)trace.code()[i].op);
+        add((std::uint32_t)trace.code()[i].operand);
+        add((std::uint32_t)trace.code()[i].arg);
+    }
+    for(size_t i = 0; i < trace.block_count(); i++) {
+        add(trace.range(i).offset);
+        add(trace.range(i).count);
+    }
+    for(size_t i = 0; i < trace.fork_count(); i++) {
+        add((std::uint32_t)trace.fork(i).child_block);
+        add((std::uint32_t)trace.fork(i).parent_index);
+    }
+    for(size_t i = 0; i < trace.program_count(); i++) {
+        for(char c : trace.program(i)) {
+            add((unsigned char)c);
+        }
+        add(0x100);
+    }
+    return hash;
+}
+
+bool write_checkpoint(const simulation_checkpoint& checkpoint, const std::string& filename) {
+    const std::string temporary = filename + ".tmp";
+    {
+        std::ofstream output_file(temporary, std::ios::binary);
+        if(!output_file.is_open()) {
+            return false;
+        }
+
+        auto put = [&](auto value) {
+            output_file.write((const char*)&value, sizeof(value));
+        };
+        auto put_count = [&](size_t count) {
+            put((std::uint64_t)count);
+        };
+
+        output_file.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        put((std::uint32_t)0x01020304);
+        put(checkpoint.trace_hash);
+        put(checkpoint.steps);
+        put(checkpoint.time);
+        put(checkpoint.execution_offset);
+        put(checkpoint.status_offset);
+        put(checkpoint.partition_count);
+
+        put_count(checkpoint.occupancy.size());
+        for(std::uint64_t word : checkpoint.occupancy) {
+            put(word);
+        }
+        put_count(checkpoint.names.size());
+        for(const auto& name : checkpoint.names) {
+            put_count(name.size());
+            output_file.write(name.data(), name.size());
+        }
+        put_count(checkpoint.processes.size());
+        for(const auto& process : checkpoint.processes) {
+            put(process.PID);
+            put(process.PPID);
+            put(process.program);
+            put(process.size);
+            put(process.partition_number);
+        }
+        put_count(checkpoint.free_slots.size());
+        for(int slot : checkpoint.free_slots) {
+            put(slot);
+        }
+        put_count(checkpoint.wait_queue.size());
+        for(int slot : checkpoint.wait_queue) {
+            put(slot);
+        }
+        put_count(checkpoint.frames.size());
+        for(const auto& frame : checkpoint.frames) {
+            put(frame.program);
+            put(frame.block);
+            put(frame.pc);
+            put(frame.process);
+            put(frame.release_partition);
+            put((std::uint8_t)frame.parent_waiting);
+            put((std::uint8_t)frame.owns_process);
+        }
+
+        output_file.flush();
+        if(!output_file) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, filename, error);
+    return !error;
+}
+
+simulation_checkpoint load_checkpoint(const std::string& filename) {
+    auto fail = [&](const char* reason) {
+        std::cerr << "Error: Invalid checkpoint " << filename << ": " << reason << std::endl;
+        exit(1);
+    };
+
+    mapped_file file;
+    if(!file.open(filename)) {
+        fail("unable to read it");
+    }
+
+    size_t position = 0;
+    auto get = [&](auto& value) {
+        if(file.size() - position < sizeof(value)) {
+            fail("truncated");
+        }
+        std::memcpy(&value, file.data() + position, sizeof(value));
+        position += sizeof(value);
+    };
+    //a count, checked against what is left so a corrupt one cannot ask for too much
+    auto get_count = [&](size_t element_size) {
+        std::uint64_t count;
+        get(count);
+        if(count > (file.size() - position) / element_size) {
+            fail("truncated");
+        }
+        return (size_t)count;
+    };
+
+    char magic[8];
+    std::uint32_t byte_order;
+    get(magic);
+    get(byte_order);
+    if(!std::equal(magic, magic + 8, CHECKPOINT_MAGIC)) {
+        fail("bad magic");
+    }
+    if(byte_order != 0x01020304) {
+        fail("written on a machine with a different byte order");
+    }
+
+    simulation_checkpoint checkpoint;
+    get(checkpoint.trace_hash);
+    get(checkpoint.steps);
+    get(checkpoint.time);
+    get(checkpoint.execution_offset);
+    get(checkpoint.status_offset);
+    get(checkpoint.partition_count);
+
+    checkpoint.occupancy.resize(get_count(sizeof(std::uint64_t)));
+    for(auto& word : checkpoint.occupancy) {
+        get(word);
+    }
+    checkpoint.names.resize(get_count(sizeof(std::uint64_t)));
+    for(auto& name : checkpoint.names) {
+        name.resize(get_count(1));
+        std::memcpy(name.data(), file.data() + position, name.size());
+        position += name.size();
+    }
+    checkpoint.processes.resize(get_count(5 * sizeof(int)));
+    for(auto& process : checkpoint.processes) {
+        get(process.PID);
+        get(process.PPID);
+        get(process.program);
+        get(process.size);
+        get(process.partition_number);
+    }
+    checkpoint.free_slots.resize(get_count(sizeof(int)));
+    for(int& slot : checkpoint.free_slots) {
+        get(slot);
+    }
+    checkpoint.wait_queue.resize(get_count(sizeof(int)));
+    for(int& slot : checkpoint.wait_queue) {
+        get(slot);
+    }
+    checkpoint.frames.resize(get_count(4 * sizeof(int) + sizeof(std::uint64_t) + 2));
+    for(auto& frame : checkpoint.frames) {
+        std::uint8_t parent_waiting, owns_process;
+        get(frame.program);
+        get(frame.block);
+        get(frame.pc);
+        get(frame.process);
+        get(frame.release_partition);
+        get(parent_waiting);
+        get(owns_process);
+        frame.parent_waiting = parent_waiting != 0;
+        frame.owns_process = owns_process != 0;
+    }
+
+    if(position != file.size()) {
+        fail("trailing bytes");
+    }
+    return checkpoint;
+}
+
+bool truncate_log(const std::string& filename, std::uint64_t size) {
+    std::error_code error;
+    std::uintmax_t length = std::filesystem::file_size(filename, error);
+    if(error || length < size) {
+        return false;
+    }
+    std::filesystem::resize_file(filename, size, error);
+    return !error;
+}
+
+simulation_checkpoint capture_checkpoint(const std::vector<process_frame>& frames, std::uint64_t steps, int time,
+                                         const symbol_table& symbols, const partition_manager& memory,
+                                         const process_table& processes, const process_queue& wait_queue) {
+    simulation_checkpoint checkpoint;
+    checkpoint.steps = steps;
+    checkpoint.time = time;
+    checkpoint.partition_count = memory.count();
+    checkpoint.occupancy = memory.occupancy();
+
+    //the symbol ids are the indexes into the names
+    for(size_t id = 0; id < symbols.size(); id++) {
+        checkpoint.names.push_back(symbols.name(id));
+    }
+    for(size_t slot = 0; slot < processes.PID.size(); slot++) {
+        checkpoint.processes.push_back({processes.PID[slot], processes.PPID[slot], processes.program[slot],
+                                        processes.size[slot], processes.partition_number[slot]});
+    }
+    checkpoint.free_slots = processes.free_list();
+    checkpoint.wait_queue = wait_queue.entries();
+    for(const auto& frame : frames) {
+        checkpoint.frames.push_back({frame.program, frame.block, frame.pc, frame.process, frame.release_partition,
+                                     frame.parent_waiting, frame.owns_process});
+    }
+    return checkpoint;
+}
+
+bool restore_checkpoint(const simulation_checkpoint& checkpoint, const compiled_trace& trace,
+                        const simulation_context& context, partition_manager& memory, process_table& processes,
+                        process_queue& wait_queue, std::vector<process_frame>& frames, std::string& error) {
+    auto fail = [&](const char* reason) {
+        error = std::string("Cannot resume from the checkpoint: ") + reason;
+        return false;
+    };
+
+    if(checkpoint.trace_hash != trace_fingerprint(trace)) {
+        return fail("it was taken of another trace");
+    }
+    if(checkpoint.partition_count != memory.count() || checkpoint.occupancy.size() != memory.occupancy().size()) {
+        return fail("the partition table has another number of partitions");
+    }
+    memory.set_occupancy(checkpoint.occupancy);
+
+    //names of the checkpoint to symbols of this run, -1 for none
+    auto symbol = [&](int index) {
+        if(index < 0 || (size_t)index >= checkpoint.names.size()) {
+            return -1;
+        }
+        return context.symbols.find(checkpoint.names[index]);
+    };
+
+    const size_t slots = checkpoint.processes.size();
+    auto valid_slot = [&](int slot) {
+        return slot >= 0 && (size_t)slot < slots;
+    };
+
+    for(const auto& process : checkpoint.processes) {
+        int program = symbol(process.program);
+        if(program == -1) {
+            return fail("it runs a program this run does not know");
+        }
+        processes.add(process.PID, process.PPID, program, process.size, process.partition_number);
+    }
+    for(int slot : checkpoint.free_slots) {
+        if(!valid_slot(slot)) {
+            return fail("process out of range");
+        }
+    }
+    processes.set_free_list(checkpoint.free_slots);
+    for(int slot : checkpoint.wait_queue) {
+        if(!valid_slot(slot)) {
+            return fail("process out of range");
+        }
+        wait_queue.push(slot, processes.PID[slot]);
+    }
+
+    frames.clear();
+    for(const auto& saved : checkpoint.frames) {
+        const compiled_trace* code = &trace;
+        int program = -1;
+        if(saved.program != -1) {
+            program = symbol(saved.program);
+            if(program == -1) {
+                return fail("it runs a program this run does not know");
+            }
+            const program_image* image = context.programs.find(program);
+            if(image == nullptr) {
+                return fail("it runs a program that is not in the external files");
+            }
+            code = &context.programs.trace(*image);
+        }
+        if(saved.block < 0 || (size_t)saved.block >= code->block_count() || saved.pc > code->block(saved.block).size()) {
+            return fail("instruction out of range");
+        }
+        if(!valid_slot(saved.process)) {
+            return fail("process out of range");
+        }
+
+        //recordings of exec_memo do not carry over: its cache starts empty
+        frames.push_back({code, saved.block, (size_t)saved.pc, saved.process, saved.release_partition,
+                          saved.parent_waiting, saved.owns_process, -1, program});
+    }
+    if(frames.empty()) {
+        return fail("it has no process to run");
+    }
+    return true;
+}
+
+std::unique_ptr<scheduler> make_scheduler(scheduling_policy policy, int quantum,
+                                          std::pmr::memory_resource* arena) {
+    switch(policy) {
+        case scheduling_policy::FCFS:                   return std::make_unique<fcfs_scheduler>(arena);
+        case scheduling_policy::ROUND_ROBIN:            return std::make_unique<round_robin_scheduler>(quantum, arena);
+        case scheduling_policy::MULTILEVEL_FEEDBACK:    return std::make_unique<feedback_scheduler>(quantum, arena);
+        default:                                        return std::make_unique<priority_scheduler>(arena);
+    }
+}
+
+bool simulate(const compiled_trace& trace, const simulation_context& context,
+              const simulation_options& options, event_sink& sink, std::string& error,
+              checkpointer* checkpoints, const simulation_checkpoint* resume) {
+
+    //Memory is partitioned as the partition table says; every simulation has its own,
+    //and its own arena for what it allocates and frees as processes come and go
+    simulation_arena arena;
+    partition_manager memory(context.partitions, arena.resource());
+
+    //Make initial PCB (notice how partition is not assigned yet)
+    PCB current(0, -1, "init", 1, -1);
+    //Update memory (partition is assigned here, you must implement this function)
+    if(!allocate_memory(memory, &current)) {
+        error = "Memory allocation failed: no partition has room for init";
+        return false;
+    }
+    sink.partition_changed(0, current.partition_number, true);
+
+    //Every process lives in the process table from here on
+    process_table processes(context.symbols);
+    process_queue wait_queue;
+    //a resumed run gets its processes from the checkpoint
+    const int init = resume ? -1 : processes.add(current);
+    if(init == -1 && !resume) {
+        error = "No symbol for program init";
+        return false;
+    }
+
+    //each cost model is its own instantiation, so the costs are constants inside it
+    const bool hardware_save = options.costs == kernel_cost_model::HARDWARE_SAVE;
+    if(options.cores > 1) {
+        auto run = hardware_save ? simulate_multicore<hardware_save_kernel_costs>
+                                 : simulate_multicore<standard_kernel_costs>;
+        run(trace, 0, 0, context, memory, processes, init, options.scheduler, options.quantum,
+            options.cores, options.io == io_model::OVERLAPPED, sink, options.coalesce_window);
+        return true;
+    }
+    if(options.io == io_model::OVERLAPPED || options.scheduler != scheduling_policy::RUN_TO_COMPLETION) {
+        std::unique_ptr<scheduler> policy = make_scheduler(options.scheduler, options.quantum, arena.resource());
+        auto run = hardware_save ? simulate_scheduled<hardware_save_kernel_costs>
+                                 : simulate_scheduled<standard_kernel_costs>;
+        run(trace, 0, 0, context, memory, processes, init, *policy,
+            options.io == io_model::OVERLAPPED, sink, options.coalesce_window);
+        return true;
+    }
+
+    auto run = hardware_save ? simulate_trace<hardware_save_kernel_costs>
+                             : simulate_trace<standard_kernel_costs>;
+
+    //the cache records what goes to the sink, so it takes the sink's place
+    std::unique_ptr<exec_memo> memo;
+    if(options.memoize_exec) {
+        memo = std::make_unique<exec_memo>(sink, context.symbols);
+    }
+
+    if(resume) {
+        //the checkpoint has the memory, the processes and the wait queue as they were
+        auto go_on = hardware_save ? resume_trace<hardware_save_kernel_costs>
+                                   : resume_trace<standard_kernel_costs>;
+        if(go_on(*resume, trace, context, memory, processes, wait_queue, memo ? *memo : sink, error, memo.get(),
+                 checkpoints, options.coalesce_window) == -1) {
+            return false;
+        }
+    } else {
+        run(trace, 
+            0, 
+            0, 
+            context, 
+            memory, 
+            processes,
+            init, 
+            wait_queue,
+            memo ? *memo : sink,
+            memo.get(),
+            checkpoints,
+            options.coalesce_window);
+    }
+
+    if(checkpoints && !checkpoints->error().empty()) {
+        error = checkpoints->error();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+/**
+ *
+ * @file log_renderer.cpp
+ * @brief renders a binary event log (see --binary-log) as the text logs, or a system
+ *        status file with deltas (see --status-deltas) as full tables; --analyze
+ *        writes the timeline analysis of a binary event log (see --analyze)
+ *
+ * The text is byte for byte what the simulator writes without either option.
+ * The analysis is the one the simulator writes with --analyze.
+ *
+ */
+
+#include "Interrupts_101166589_101257741.hpp"
+
+int main(int argc, char** argv) {
+    if(argc == 4 && std::string_view(argv[1]) == "--status-deltas") {
+        if(!materialize_status_deltas(argv[2], argv[3])) {
+            std::cerr << "Error opening file!" << std::endl;
+            exit(1);
+        }
+        return 0;
+    }
+
+    if(argc == 4 && std::string_view(argv[1]) == "--analyze") {
+        if(!analyze_binary_log(argv[2], argv[3])) {
+            std::cerr << "Error opening file!" << std::endl;
+            exit(1);
+        }
+        return 0;
+    }
+
+    if(argc != 4) {
+        std::cout << "Usage: ./log_renderer <events.bin> <execution.txt> <system_status.txt>\n"
+                     "   or: ./log_renderer --status-deltas <system_status_delta.txt> <system_status.txt>\n"
+                     "   or: ./log_renderer --analyze <events.bin> <analysis.txt>" << std::endl;
+        exit(1);
+    }
+
+    if(!render_binary_log(argv[1], argv[2], argv[3])) {
+        std::cerr << "Error opening file!" << std::endl;
+        exit(1);
+    }
+
+    return 0;
+}
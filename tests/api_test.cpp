@@ -0,0 +1,150 @@
+/**
+ *
+ * @file api_test.cpp
+ * @brief checks the embeddable API (see simulator) against the golden logs
+ *
+ * Run by ctest as api_test <source dir>, from a scratch directory. For every golden
+ * trace it builds a simulator from the tables of the source tree, and checks that
+ * - a text_log_sink through the API writes the golden logs,
+ * - callback_sink and an event_ring see the same events,
+ * - runs of one simulator on several threads at once all see every event.
+ * It also checks that a malformed trace, one raising interrupts the tables do not have,
+ * a bad binary trace and a run with no partition for init come back as errors.
+ *
+ */
+
+#include "Interrupts_101166589_101257741.hpp"
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if(!ok) {
+        std::cout << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+//The lines of a text file, without blank ones
+std::vector<std::string> read_lines(const std::string& filename) {
+    std::ifstream input_file(filename);
+    std::vector<std::string> lines;
+    std::string line;
+    while(std::getline(input_file, line)) {
+        if(!trim(line).empty()) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+std::string read_file(const std::string& filename) {
+    std::ifstream input_file(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input_file), std::istreambuf_iterator<char>());
+}
+
+bool same_events(const simulation_event& a, const simulation_event& b) {
+    return a.time == b.time && a.duration == b.duration && a.operand == b.operand && a.core == b.core
+           && a.kind == b.kind;
+}
+
+void check_trace(const std::string& source, const std::string& name) {
+    simulator sim(load_vector_table(source + "/vector_table.txt"), load_device_table(source + "/device_table.txt"));
+    std::string error;
+    for(const auto& file : load_external_files(source + "/external_files.txt")) {
+        check(sim.add_program(file.program_name, file.size, read_lines(source + "/" + file.program_name + ".txt"), error),
+              name + ": adding " + file.program_name + ": " + error);
+    }
+    compiled_trace trace;
+    if(!sim.compile(read_lines(source + "/input_files/" + name + ".txt"), trace, error)) {
+        check(false, name + ": " + error);
+        return;
+    }
+
+    const std::string golden = source + "/tests/golden/" + name;
+    {
+        text_log_sink log((name + "_execution.txt").c_str(), (name + "_system_status.txt").c_str(),
+                          sim.context().vectors);
+        check(sim.run(trace, simulation_options(), log, error), name + ": " + error);
+    }
+    check(read_file(name + "_execution.txt") == read_file(golden + "/execution.txt"), name + ": execution log");
+    check(read_file(name + "_system_status.txt") == read_file(golden + "/system_status.txt"),
+          name + ": system status log");
+
+    std::vector<simulation_event> called;
+    callback_sink callbacks([&](const simulation_event& event) { called.push_back(event); });
+    check(sim.run(trace, simulation_options(), callbacks, error), name + ": " + error);
+
+    //a ring much smaller than the run, so the simulation has to wait for the consumer
+    std::vector<simulation_event> streamed;
+    event_ring ring(8);
+    std::string stream_error;
+    bool streamed_ok = false;
+    std::thread producer([&] { streamed_ok = sim.stream(trace, simulation_options(), ring, stream_error); });
+    while(ring.consume([&](const simulation_event& event) { streamed.push_back(event); }, 3) > 0) {}
+    producer.join();
+    check(streamed_ok, name + ": " + stream_error);
+
+    check(!called.empty(), name + ": no events");
+    check(called.size() == streamed.size()
+          && std::equal(called.begin(), called.end(), streamed.begin(), same_events),
+          name + ": the ring and the callbacks saw different events");
+
+    std::vector<size_t> counts(4);
+    std::vector<std::thread> runs;
+    for(size_t i = 0; i < counts.size(); i++) {
+        runs.emplace_back([&, i] {
+            callback_sink counter([&](const simulation_event&) { counts[i]++; });
+            std::string run_error;
+            sim.run(trace, simulation_options(), counter, run_error);
+        });
+    }
+    for(auto& run : runs) {
+        run.join();
+    }
+    for(size_t count : counts) {
+        check(count == called.size(), name + ": a parallel run saw " + std::to_string(count) + " events, not "
+                                      + std::to_string(called.size()));
+    }
+}
+
+void check_errors(const std::string& source) {
+    simulator sim({"0X01E3"}, {100});
+    compiled_trace trace;
+    std::string error;
+
+    check(!sim.compile({"CPU, 10", "CPU ten"}, trace, error), "a malformed line was accepted");
+    check(error.find("line 2") != std::string::npos, "the error does not name the line: " + error);
+
+    check(!sim.compile({"CPU, 10", "SYSCALL, 99"}, trace, error), "a SYSCALL of a device with no entry was accepted");
+    check(error.find("line 2") != std::string::npos, "the error does not name the line: " + error);
+    check(!sim.compile({"CPU, 10", "END_IO, -1"}, trace, error), "an END_IO of device -1 was accepted");
+    check(!sim.compile({"FORK, 10"}, trace, error), "a FORK with no vector for it was accepted");
+    check(!sim.add_program("program2", 10, {"SYSCALL, 1"}, error),
+          "a program with a SYSCALL of a device with no entry was added");
+
+    check(!sim.load(source + "/vector_table.txt", trace, error), "a text file loaded as a binary trace");
+    check(!sim.load("no such file.bin", trace, error), "a missing binary trace loaded");
+
+    check(sim.add_program("program1", 10, {"CPU, 10"}, error), "adding a program failed: " + error);
+    check(!sim.add_program("program1", 10, {"CPU, 10"}, error), "a program was added twice");
+
+    //init needs a partition of at least 1
+    simulator full({"0X01E3"}, {100}, {memory_partition_t(1, 0)});
+    callback_sink ignore([](const simulation_event&) {});
+    check(full.compile({"CPU, 10"}, trace, error), "compiling failed: " + error);
+    check(!full.run(trace, simulation_options(), ignore, error), "a run with no partition for init went on");
+}
+
+int main(int argc, char** argv) {
+    if(argc != 2) {
+        std::cout << "Usage: ./api_test <source dir>" << std::endl;
+        return 1;
+    }
+
+    for(int n = 1; n <= 5; n++) {
+        check_trace(argv[1], "trace_" + std::to_string(n));
+    }
+    check_errors(argv[1]);
+
+    return failures == 0 ? 0 : 1;
+}
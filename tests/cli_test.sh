@@ -0,0 +1,544 @@
+#!/bin/bash
+# One check of the command line tools, run by ctest (see CMakeLists.txt):
+#
+#   cli_test.sh <check> <trace> <bin dir> <source dir> <work dir>
+#
+# Every check runs in a fresh <work dir> holding the tables and programs of the
+# source tree, and compares what the tools write with tests/golden/<trace>:
+#
+#   golden          the text logs of a plain run
+#   binary_log      --binary-log, rendered back to text by log_renderer
+#   status_deltas   --status-deltas=2, expanded back to full tables by log_renderer
+#   checkpoint      --checkpoint-at every instruction, then --resume from each
+#                   checkpoint onto logs with junk past the checkpoint
+#   batch           every golden trace as one --batch manifest (<trace> is ignored)
+#   rejected        option combinations that have to fail instead of dropping an option
+#   multicore       --cores on a small trace worked out by hand, and on every golden trace
+#                   no core going back in time, no child running before its FORK is done
+#                   and no negative times in --stats (<trace> is ignored)
+#   scheduling      each --scheduler on a small trace worked out by hand: the CPU bursts
+#                   and the turnaround, wait and response of both processes (<trace> is ignored)
+#   overlapped_io   --io=overlapped on a small trace worked out by hand: the parent runs
+#                   while the I/O of its child is outstanding (<trace> is ignored)
+#   memoize_exec    --memoize-exec on a trace whose second EXEC is replayed from the cache,
+#                   and on every golden trace, against the logs without it (<trace> is ignored)
+#   sweep           --sweep of every parameter on a small trace, each row worked out by hand
+#                   (<trace> is ignored)
+#   analyze         --analyze on a small trace worked out by hand, and log_renderer --analyze
+#                   of its --binary-log (<trace> is ignored)
+#   coalesce        --coalesce-end-io on back to back END_IOs worked out by hand: the log and
+#                   the coalesced and uncoalesced counts (<trace> is ignored)
+#   stats           --stats on a small trace worked out by hand, and on every golden trace
+#                   the totals its execution log adds up to (<trace> is ignored)
+
+check=$1
+trace=$2
+bin=$3
+source=$4
+work=$5
+
+golden=$source/tests/golden/$trace
+
+fail() {
+    echo "FAIL: $*"
+    exit 1
+}
+
+#Runs the simulator on a trace file, with the options given
+simulate_file() {
+    local file=$1
+    shift
+    "$bin/interrupts" "$file" vector_table.txt device_table.txt external_files.txt "$@" >> run.log 2>&1
+}
+
+#Runs the simulator on the trace, with the options given
+simulate() {
+    simulate_file "$source/input_files/$trace.txt" "$@"
+}
+
+same() {
+    cmp -s "$1" "$2" || fail "$1 differs from $2"
+}
+
+#Checks that a file holds exactly what comes on standard input
+expect() {
+    cat > expected.txt
+    diff expected.txt "$1" >> run.log || fail "$1 is not as expected (see run.log)"
+}
+
+#Checks that a file has each of the lines given
+has() {
+    local file=$1
+    shift
+    for line in "$@"; do
+        grep -qxF -- "$line" "$file" || fail "$file has no line '$line'"
+    done
+}
+
+#A FORK whose child runs a 50 burst while the parent runs a 20 one
+fork_trace() {
+    cat > fork.txt <<'EOF'
+FORK, 10
+IF_CHILD, 0
+CPU, 50
+IF_PARENT, 0
+CPU, 20
+ENDIF, 0
+EOF
+}
+
+#A FORK whose child makes a SYSCALL to device 1 (100) while the parent has a 100 burst to run
+io_trace() {
+    cat > io.txt <<'EOF'
+FORK, 10
+IF_CHILD, 0
+SYSCALL, 1
+CPU, 10
+IF_PARENT, 0
+CPU, 100
+ENDIF, 0
+EOF
+}
+
+rm -rf "$work"
+mkdir -p "$work/output_files"
+cp "$source"/vector_table.txt "$source"/device_table.txt "$source"/external_files.txt "$source"/program*.txt "$work"/
+cd "$work" || fail "cannot enter $work"
+
+case $check in
+    golden)
+        simulate || fail "the simulation failed"
+        same output_files/execution_5.txt "$golden/execution.txt"
+        same output_files/system_status_5.txt "$golden/system_status.txt"
+        ;;
+
+    binary_log)
+        simulate --binary-log || fail "the simulation failed"
+        "$bin/log_renderer" output_files/events_5.bin execution.txt system_status.txt >> run.log 2>&1 \
+            || fail "log_renderer failed"
+        same execution.txt "$golden/execution.txt"
+        same system_status.txt "$golden/system_status.txt"
+        ;;
+
+    status_deltas)
+        simulate --status-deltas=2 || fail "the simulation failed"
+        "$bin/log_renderer" --status-deltas output_files/system_status_delta_5.txt system_status.txt >> run.log 2>&1 \
+            || fail "log_renderer failed"
+        same output_files/execution_5.txt "$golden/execution.txt"
+        same system_status.txt "$golden/system_status.txt"
+        ;;
+
+    checkpoint)
+        simulate --checkpoint-at=1..1000 || fail "the simulation failed"
+        same output_files/execution_5.txt "$golden/execution.txt"
+        same output_files/system_status_5.txt "$golden/system_status.txt"
+
+        mkdir checkpoints
+        mv output_files/checkpoint_5_*.bin checkpoints/ 2>/dev/null || fail "no checkpoint was taken"
+        for checkpoint in checkpoints/*.bin; do
+            #a resumed run has to cut the logs back to the checkpoint itself
+            echo "junk past the checkpoint" >> output_files/execution_5.txt
+            echo "junk past the checkpoint" >> output_files/system_status_5.txt
+            simulate --resume="$checkpoint" || fail "resuming from $checkpoint failed"
+            same output_files/execution_5.txt "$golden/execution.txt"
+            same output_files/system_status_5.txt "$golden/system_status.txt"
+        done
+        ;;
+
+    batch)
+        : > manifest.txt
+        for expected in "$source"/tests/golden/*; do
+            name=$(basename "$expected")
+            echo "$source/input_files/$name.txt,vector_table.txt,device_table.txt,external_files.txt,output_files/${name}_" \
+                >> manifest.txt
+        done
+        "$bin/interrupts" --batch manifest.txt --jobs=2 >> run.log 2>&1 || fail "the batch failed"
+        for expected in "$source"/tests/golden/*; do
+            name=$(basename "$expected")
+            same "output_files/${name}_execution.txt" "$expected/execution.txt"
+            same "output_files/${name}_system_status.txt" "$expected/system_status.txt"
+        done
+        ;;
+
+    rejected)
+        printf 'delay_scale: 100, 200\n' > sweep.txt
+        echo "$source/input_files/$trace.txt,vector_table.txt,device_table.txt,external_files.txt,output_files/" \
+            > manifest.txt
+        while read -r options; do
+            # shellcheck disable=SC2086
+            simulate $options && fail "$options was accepted"
+        done <<'EOF'
+--stats --binary-log
+--analyze --status-deltas
+--memoize-exec --scheduler=rr
+--memoize-exec --io=overlapped
+--memoize-exec --cores=2
+--sweep=sweep.txt --costs=hardware-save
+--sweep=sweep.txt --coalesce-end-io=5
+--sweep=sweep.txt --stats
+--checkpoint-every=5 --binary-log
+EOF
+        "$bin/interrupts" --batch manifest.txt --jobs 2 >> run.log 2>&1 && fail "--batch with --jobs <N> was accepted"
+        "$bin/interrupts" --batch manifest.txt --jobs=1 >> run.log 2>&1 || fail "--batch with --jobs=N failed"
+        ;;
+
+    multicore)
+        #the child goes to the idle core 1, which has to wait for the clone to end at 24
+        fork_trace
+        simulate_file fork.txt --cores=2 || fail "the simulation failed"
+        expect output_files/execution_5.txt <<'EOF'
+0, 1, core 0: switch to kernel mode
+1, 10, core 0: context saved
+11, 1, core 0: find vector 2 in memory position 0x0004
+12, 1, core 0: load address 0X0695 into the PC
+13, 10, core 0: cloning the PCB
+23, 0, core 0: scheduler called
+23, 1, core 0: IRET
+24, 20, core 0: CPU Burst
+0, 24, core 1: CPU idle
+24, 50, core 1: CPU Burst
+EOF
+        simulate_file fork.txt --cores=2 --stats || fail "the simulation failed"
+        has output_files/stats_5.txt "total time: 74" "user time: 70" "kernel time: 24" "idle time: 24" \
+            "core 0: 44 busy, 0 idle, 59.5% utilization" "core 1: 50 busy, 24 idle, 67.6% utilization" \
+            "process 1 (init): 50 turnaround, 0 wait, 0 response" \
+            "process 0 (init): 74 turnaround, 0 wait, 0 response"
+
+        for expected in "$source"/tests/golden/*; do
+            name=$(basename "$expected")
+            for cores in 2 3 4; do
+                simulate_file "$source/input_files/$name.txt" --cores=$cores || fail "$name --cores=$cores failed"
+                awk '
+                    {
+                        split($0, field, ", ")
+                        time = field[1] + 0
+                        core = field[3]
+                        sub(/^core /, "", core)
+                        sub(/:.*/, "", core)
+                        text = $0
+                        sub(/^[^:]*: /, "", text)
+
+                        if(core in end && time < end[core]) {
+                            print "core " core " goes back in time: " $0
+                            bad = 1
+                        }
+                        end[core] = time + field[2]
+
+                        #only the first process (on core 0) runs until the first FORK is done
+                        if(core == 0 && text == "cloning the PCB" && fork_end == "") {
+                            cloning = 1
+                        } else if(core == 0 && cloning && text == "IRET") {
+                            fork_end = time + field[2]
+                            cloning = 0
+                        } else if(core != 0 && text != "CPU idle" && (fork_end == "" || time < fork_end)) {
+                            print "core " core " runs before the first FORK is done: " $0
+                            bad = 1
+                        }
+                    }
+                    END { exit bad }' output_files/execution_5.txt >> run.log \
+                    || fail "$name --cores=$cores: the execution log is out of order (see run.log)"
+
+                simulate_file "$source/input_files/$name.txt" --cores=$cores --stats \
+                    || fail "$name --cores=$cores --stats failed"
+                grep -- "-[0-9]" output_files/stats_5.txt >> run.log \
+                    && fail "$name --cores=$cores: negative times (see run.log)"
+            done
+        done
+        ;;
+
+    scheduling)
+        #both processes are ready at 24, the parent (0) with 20 of CPU to go and the child
+        #(1) with 50; the parent only exits once its child has, at 94
+        fork_trace
+        schedule() {
+            simulate_file fork.txt "$@" || fail "$* failed"
+            tail -n +8 output_files/execution_5.txt > user.txt
+            simulate_file fork.txt "$@" --stats || fail "$* --stats failed"
+        }
+
+        schedule --scheduler=fcfs
+        expect user.txt <<'EOF'
+24, 20, CPU Burst
+44, 50, CPU Burst
+EOF
+        has output_files/stats_5.txt "process 1 (init): 70 turnaround, 20 wait, 20 response" \
+            "process 0 (init): 94 turnaround, 0 wait, 0 response"
+
+        #the parent is done within its second slice, at 59
+        schedule --scheduler=rr --quantum=15
+        expect user.txt <<'EOF'
+24, 15, CPU Burst
+39, 0, scheduler called
+39, 15, CPU Burst
+54, 0, scheduler called
+54, 5, CPU Burst
+59, 15, CPU Burst
+74, 15, CPU Burst
+89, 5, CPU Burst
+EOF
+        has output_files/stats_5.txt "process 1 (init): 70 turnaround, 20 wait, 15 response" \
+            "process 0 (init): 94 turnaround, 15 wait, 0 response"
+
+        #the child is the newest process, so it runs first and is never preempted
+        schedule --scheduler=priority
+        expect user.txt <<'EOF'
+24, 50, CPU Burst
+74, 20, CPU Burst
+EOF
+        has output_files/stats_5.txt "process 1 (init): 50 turnaround, 0 wait, 0 response" \
+            "process 0 (init): 94 turnaround, 50 wait, 0 response"
+
+        #both use up 10 on the top level; on the next one (20) the parent is done at 54
+        #and the child runs on alone
+        schedule --scheduler=mlfq --quantum=10
+        expect user.txt <<'EOF'
+24, 10, CPU Burst
+34, 0, scheduler called
+34, 10, CPU Burst
+44, 0, scheduler called
+44, 10, CPU Burst
+54, 20, CPU Burst
+74, 20, CPU Burst
+EOF
+        has output_files/stats_5.txt "process 1 (init): 70 turnaround, 20 wait, 10 response" \
+            "process 0 (init): 94 turnaround, 10 wait, 0 response"
+        ;;
+
+    overlapped_io)
+        #the child runs first
+        io_trace
+        simulate_file io.txt || fail "the simulation failed"
+        tail -1 output_files/execution_5.txt > serial.txt
+        expect serial.txt <<'EOF'
+148, 100, CPU Burst
+EOF
+
+        #the device is done at 138, in the middle of the parent's burst, so the END_IO
+        #interrupt comes at 139; the child takes the CPU back from its parent for its
+        #last 10, and the parent waits those out too
+        simulate_file io.txt --io=overlapped || fail "the simulation failed"
+        expect output_files/execution_5.txt <<'EOF'
+0, 1, switch to kernel mode
+1, 10, context saved
+11, 1, find vector 2 in memory position 0x0004
+12, 1, load address 0X0695 into the PC
+13, 10, cloning the PCB
+23, 0, scheduler called
+23, 1, IRET
+24, 1, switch to kernel mode
+25, 10, context saved
+35, 1, find vector 1 in memory position 0x0002
+36, 1, load address 0X029C into the PC
+37, 1, start I/O on device 1
+38, 0, scheduler called
+38, 1, IRET
+39, 100, CPU Burst
+139, 1, switch to kernel mode
+140, 10, context saved
+150, 1, find vector 1 in memory position 0x0002
+151, 1, load address 0X029C into the PC
+152, 1, END_IO: run the ISR
+153, 1, IRET
+154, 10, CPU Burst
+EOF
+        simulate_file io.txt --io=overlapped --stats || fail "the simulation failed"
+        has output_files/stats_5.txt "total time: 164" "user time: 110" "kernel time: 54" \
+            "device 1: 1 syscall(s), 1 end of I/O, 2 ISR time" \
+            "process 1 (init): 140 turnaround, 0 wait, 0 response" \
+            "process 0 (init): 164 turnaround, 25 wait, 0 response"
+        ;;
+
+    memoize_exec)
+        #the second child gets PID 1 again, and execs program1 from the same state as the
+        #first, so its run is replayed
+        cat > memo.txt <<'EOF'
+FORK, 10
+IF_CHILD, 0
+EXEC program1, 50
+IF_PARENT, 0
+ENDIF, 0
+CPU, 10
+FORK, 10
+IF_CHILD, 0
+EXEC program1, 50
+IF_PARENT, 0
+ENDIF, 0
+CPU, 10
+EOF
+        simulate_file memo.txt || fail "the simulation failed"
+        mv output_files/execution_5.txt execution.txt
+        mv output_files/system_status_5.txt system_status.txt
+        simulate_file memo.txt --stats || fail "the simulation failed"
+        mv output_files/stats_5.txt stats.txt
+
+        #both EXECs show the same tables, 357 apart
+        has system_status.txt "time: 247; current trace: EXEC, 50" "time: 604; current trace: EXEC, 50"
+        simulate_file memo.txt --memoize-exec || fail "the simulation failed"
+        same output_files/execution_5.txt execution.txt
+        same output_files/system_status_5.txt system_status.txt
+        simulate_file memo.txt --memoize-exec --stats || fail "the simulation failed"
+        same output_files/stats_5.txt stats.txt
+
+        for expected in "$source"/tests/golden/*; do
+            name=$(basename "$expected")
+            simulate_file "$source/input_files/$name.txt" --memoize-exec || fail "$name --memoize-exec failed"
+            same output_files/execution_5.txt "$expected/execution.txt"
+            same output_files/system_status_5.txt "$expected/system_status.txt"
+        done
+        ;;
+
+    sweep)
+        #with room for program1 the trace takes 327 + 2 context saves + the delay of
+        #device 1 (there are two interrupts), without it the EXEC fails 17 + 2 context
+        #saves + the delay in
+        printf 'CPU, 10\nSYSCALL, 1\nEXEC program1, 50\n' > sweep_trace.txt
+        printf '8\n2\n' > small_partitions.txt
+        printf '100\n300\n150\n150\n' > slow_devices.txt
+        cat > sweep.txt <<'EOF'
+device_table: device_table.txt, slow_devices.txt
+delay_scale: 50, 100
+context_save: 10, 30
+partition_table: default, small_partitions.txt
+EOF
+        simulate_file sweep_trace.txt --sweep=sweep.txt --jobs=2 || fail "the sweep failed"
+        expect output_files/sweep_5.txt <<'EOF'
+partition_table,device_table,delay_scale,context_save,total_time,allocation_failures
+default,device_table.txt,50,10,397,0
+default,device_table.txt,50,30,437,0
+default,device_table.txt,100,10,447,0
+default,device_table.txt,100,30,487,0
+default,slow_devices.txt,50,10,497,0
+default,slow_devices.txt,50,30,537,0
+default,slow_devices.txt,100,10,647,0
+default,slow_devices.txt,100,30,687,0
+small_partitions.txt,device_table.txt,50,10,87,1
+small_partitions.txt,device_table.txt,50,30,127,1
+small_partitions.txt,device_table.txt,100,10,137,1
+small_partitions.txt,device_table.txt,100,30,177,1
+small_partitions.txt,slow_devices.txt,50,10,187,1
+small_partitions.txt,slow_devices.txt,50,30,227,1
+small_partitions.txt,slow_devices.txt,100,10,337,1
+small_partitions.txt,slow_devices.txt,100,30,377,1
+EOF
+
+        #a row is what a plain run with those tables gives
+        simulate_file sweep_trace.txt small_partitions.txt --stats || fail "the simulation failed"
+        has output_files/stats_5.txt "total time: 137" "errors: 1"
+        ;;
+
+    analyze)
+        #the FORK interrupt is in kernel mode from 0 to 24 and the SYSCALL one from 24 to
+        #138, of which device 1 has 100
+        io_trace
+        simulate_file io.txt --analyze || fail "the simulation failed"
+        expect output_files/analysis_5.txt <<'EOF'
+events: 15
+total time: 248
+CPU_BURST: 2 event(s), 110 busy, 44.4%
+SWITCH_TO_KERNEL: 2 event(s), 2 busy, 0.8%
+CONTEXT_SAVED: 2 event(s), 20 busy, 8.1%
+FIND_VECTOR: 2 event(s), 2 busy, 0.8%
+LOAD_ADDRESS: 2 event(s), 2 busy, 0.8%
+SYSCALL_ISR: 1 event(s), 100 busy, 40.3%
+IRET: 2 event(s), 2 busy, 0.8%
+CLONE_PCB: 1 event(s), 10 busy, 4.0%
+SCHEDULER_CALLED: 1 event(s), 0 busy, 0.0%
+interrupts: 2, latency 24 min, 69.0 mean, 114 max
+latency 16..31: 1
+latency 64..127: 1
+device 1: 100 ISR time, 40.3% utilization
+EOF
+
+        simulate_file io.txt --binary-log || fail "the simulation failed"
+        "$bin/log_renderer" --analyze output_files/events_5.bin analysis.txt >> run.log 2>&1 \
+            || fail "log_renderer --analyze failed"
+        same analysis.txt output_files/analysis_5.txt
+        ;;
+
+    coalesce)
+        #an END_IO of device 1 takes 13 to enter, 100 of ISR and 1 to return; only the
+        #ones right after it, of the same device, may join it
+        printf 'CPU, 10\nEND_IO, 1\nEND_IO, 1\nEND_IO, 1\nEND_IO, 2\nCPU, 5\nEND_IO, 1\n' > end_io.txt
+        simulate_file end_io.txt --stats || fail "the simulation failed"
+        has output_files/stats_5.txt "total time: 635" "mode switches: 5" \
+            "device 1: 0 syscall(s), 4 end of I/O, 400 ISR time" "device 2: 0 syscall(s), 1 end of I/O, 150 ISR time"
+
+        #entered at 10, the first ISR ends 113 in and the second joins it; that one ends
+        #213 in, past the window
+        simulate_file end_io.txt --coalesce-end-io=150 || fail "the simulation failed"
+        head -9 output_files/execution_5.txt > coalesced.txt
+        expect coalesced.txt <<'EOF'
+0, 10, CPU Burst
+10, 1, switch to kernel mode
+11, 10, context saved
+21, 1, find vector 1 in memory position 0x0002
+22, 1, load address 0X029C into the PC
+23, 100, ENDIO ISR(ADD STEPS HERE)
+123, 0, END_IO: coalesced into this interrupt, saving 14
+123, 100, ENDIO ISR(ADD STEPS HERE)
+223, 1, IRET
+EOF
+        simulate_file end_io.txt --coalesce-end-io=150 --stats || fail "the simulation failed"
+        has output_files/stats_5.txt "total time: 621" "mode switches: 4" \
+            "end of I/O: 5 in 4 interrupt(s), 1 coalesced, 14 kernel time saved" \
+            "device 1: 0 syscall(s), 4 end of I/O (1 coalesced), 400 ISR time" \
+            "device 2: 0 syscall(s), 1 end of I/O (0 coalesced), 150 ISR time"
+
+        #the third joins too, the END_IO of device 2 never does
+        simulate_file end_io.txt --coalesce-end-io=250 --stats || fail "the simulation failed"
+        has output_files/stats_5.txt "total time: 607" "mode switches: 3" \
+            "end of I/O: 5 in 3 interrupt(s), 2 coalesced, 28 kernel time saved" \
+            "device 1: 0 syscall(s), 4 end of I/O (2 coalesced), 400 ISR time" \
+            "device 2: 0 syscall(s), 1 end of I/O (0 coalesced), 150 ISR time"
+        ;;
+
+    stats)
+        #the child holds partition 5 from the start of the clone at 13 until it exits at 148
+        io_trace
+        simulate_file io.txt --stats || fail "the simulation failed"
+        expect output_files/stats_5.txt <<'EOF'
+total time: 248
+user time: 110
+kernel time: 138
+mode switches: 2
+process switches: 1
+errors: 0
+device 1: 1 syscall(s), 0 end of I/O, 100 ISR time
+partition 1 (40 Mb): 0 occupied, 0.0%
+partition 2 (25 Mb): 0 occupied, 0.0%
+partition 3 (15 Mb): 0 occupied, 0.0%
+partition 4 (10 Mb): 0 occupied, 0.0%
+partition 5 (8 Mb): 135 occupied, 54.4%
+partition 6 (2 Mb): 248 occupied, 100.0%
+EOF
+
+        for expected in "$source"/tests/golden/*; do
+            name=$(basename "$expected")
+            simulate_file "$source/input_files/$name.txt" --stats || fail "$name --stats failed"
+            awk -F', ' '
+                $2 ~ /^[0-9]+$/ {
+                    end = $1 + $2
+                    if($3 == "CPU Burst") {
+                        user += $2
+                    } else {
+                        kernel += $2
+                    }
+                }
+                $3 == "switch to kernel mode" { switches++ }
+                END {
+                    print "total time: " end
+                    print "user time: " user
+                    print "kernel time: " kernel
+                    print "mode switches: " switches
+                }' "$expected/execution.txt" > totals.txt
+            head -4 output_files/stats_5.txt > stats_totals.txt
+            expect totals.txt < stats_totals.txt
+        done
+        ;;
+
+    *)
+        fail "unknown check $check"
+        ;;
+esac
+
+exit 0
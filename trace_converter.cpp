@@ -0,0 +1,37 @@
+/**
+ *
+ * @file trace_converter.cpp
+ * @brief converts a text trace into the binary trace format
+ *
+ * The simulator, the batch manifests and the EXEC program files all accept either
+ * format, so a converted trace can be dropped in place of the text one. Program files
+ * are converted one by one, like any other trace.
+ *
+ */
+
+#include "Interrupts_101166589_101257741.hpp"
+
+int main(int argc, char** argv) {
+    if(argc != 3) {
+        std::cout << "Usage: ./trace_converter <trace.txt> <trace.bin>" << std::endl;
+        exit(1);
+    }
+
+    std::ifstream input_file(argv[1]);
+    if(!input_file.is_open()) {
+        std::cerr << "Error: Unable to open file: " << argv[1] << std::endl;
+        exit(1);
+    }
+    input_file.close();
+
+    compiled_trace trace = load_trace(argv[1]);
+    if(!write_binary_trace(trace, argv[2])) {
+        std::cerr << "Error: Unable to write file: " << argv[2] << std::endl;
+        exit(1);
+    }
+
+    std::cout << argv[2] << ": " << trace.code().size() << " instructions in " << trace.block_count()
+              << " blocks, " << trace.fork_count() << " forks, " << trace.program_count() << " programs" << std::endl;
+
+    return 0;
+}